@@ -7,44 +7,124 @@ namespace arch {
 
 namespace detail_ {
 
+// Zero until CTR_EL0 has been read. CTR_EL0 is never zero since bit 31 is RES1.
+inline uint64_t ctr_el0_ = 0;
+
+inline uint64_t read_ctr() {
+	auto ctr = __atomic_load_n(&ctr_el0_, __ATOMIC_RELAXED);
+	if (!ctr) [[unlikely]] {
+		asm ("mrs %0, ctr_el0" : "=r"(ctr));
+		__atomic_store_n(&ctr_el0_, ctr, __ATOMIC_RELAXED);
+	}
+	return ctr;
+}
+
 inline size_t dcache_line_size() {
-	uint64_t ctr;
-	asm ("mrs %0, ctr_el0" : "=r"(ctr));
+	// CTR_EL0.DminLine is the log2 of the number of words in the smallest line.
+	return size_t(4) << ((read_ctr() >> 16) & 0b1111);
+}
 
-	return ((ctr >> 16) & 0b1111) << 4;
+// Calls op(line) for every cache line covering [addr,addr+size).
+// If L is non-zero, it is used as the cache line size.
+// The loop is unrolled four times to reduce loop overhead for large ranges.
+template<size_t L, typename Op>
+[[gnu::always_inline]] inline void for_each_dcache_line(uintptr_t addr, size_t size, Op op) {
+	size_t dsz = L ? L : dcache_line_size();
+	auto cur = addr & ~(dsz - 1);
+	size_t n = (addr + size - cur + dsz - 1) >> __builtin_ctzl(dsz);
+	for (; n >= 4; n -= 4) {
+		op(cur);
+		op(cur + dsz);
+		op(cur + 2 * dsz);
+		op(cur + 3 * dsz);
+		cur += 4 * dsz;
+	}
+	for (; n; n--) {
+		op(cur);
+		cur += dsz;
+	}
 }
 
-// Clean cache lines by VA to PoC.
-inline void cache_clean_poc(uintptr_t addr, size_t size) {
-	auto dsz = dcache_line_size();
-	for (auto cur = addr & ~(dsz - 1); cur < addr + size; cur += dsz) {
+// Clean cache lines by VA to PoC. Needs to be followed by cache_fence().
+template<size_t L = 0>
+inline void cache_clean_poc_lines(uintptr_t addr, size_t size) {
+	for_each_dcache_line<L>(addr, size, [] (uintptr_t cur) {
 		asm volatile ("dc cvac, %0" :: "r"(cur) : "memory");
-	}
-	asm volatile ("dmb sy" ::: "memory");
+	});
 }
 
-// Clean and invalidate cache lines by VA to PoC.
-inline void cache_clean_invalidate_poc(uintptr_t addr, size_t size) {
-	auto dsz = dcache_line_size();
-	for (auto cur = addr & ~(dsz - 1); cur < addr + size; cur += dsz) {
+// Clean and invalidate cache lines by VA to PoC. Needs to be followed by cache_fence().
+template<size_t L = 0>
+inline void cache_clean_invalidate_poc_lines(uintptr_t addr, size_t size) {
+	for_each_dcache_line<L>(addr, size, [] (uintptr_t cur) {
 		asm volatile ("dc civac, %0" :: "r"(cur) : "memory");
-	}
-	asm volatile ("dmb sy" ::: "memory");
+	});
+}
+
+inline void cache_fence() {
+	// A DMB only orders the maintenance against other memory accesses; a DSB is required
+	// to wait for its completion before the device is told about the buffer (this is also
+	// what Linux does for non-coherent DMA).
+	asm volatile ("dsb sy" ::: "memory");
 }
 
+// Maintenance operations used by arch/cache.hpp.
+// lines<L>() walks a range without a trailing barrier (using a line size of L unless L is zero),
+// fence() completes all preceding lines() calls and try_whole() maintains the entire cache
+// if that is cheaper than walking size bytes.
+
+struct writeback_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_clean_poc_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t) {
+		return false;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
+using clean_or_invalidate_op = writeback_op;
+
+// There are no non-temporal stores that are guaranteed to bypass the cache,
+// hence copies are written back line by line by the generic implementation in arch/cache.hpp.
+template<typename WritebackOp>
+struct copy_then_writeback_op;
+
+using copy_writeback_op = copy_then_writeback_op<writeback_op>;
+
+struct invalidate_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_clean_invalidate_poc_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t) {
+		return false;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
 } // namespace detail_
 
 
-inline void cache_writeback(uintptr_t addr, size_t size) {
-	detail_::cache_clean_poc(addr, size);
-}
+// Set/way operations only act on the caches of the local PE (and not on system caches),
+// and lines can migrate or be refilled while the sets are walked.
+// They cannot keep DMA buffers coherent, hence all ranges are maintained by VA line by line.
+// The whole cache threshold is only accepted for parity with other architectures.
+inline void set_whole_cache_threshold(size_t) { }
 
-inline void cache_clean_or_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_clean_poc(addr, size);
+inline size_t whole_cache_threshold() {
+	return SIZE_MAX;
 }
 
-inline void cache_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_clean_invalidate_poc(addr, size);
-}
+inline void calibrate_whole_cache_threshold() { }
 
 } // namespace arch
@@ -8,11 +8,38 @@
 namespace arch {
 
 namespace _detail {
+	// Barriers that are required around relaxed accesses to implement load() and store().
+	struct mem_barriers {
+		static void before_load() {
+			asm volatile("" ::: "memory");
+		}
+		static void after_load() {
+			asm volatile("dsb ld" ::: "memory");
+		}
+
+		static void before_store() {
+			asm volatile("dsb st" ::: "memory");
+		}
+		static void after_store() {
+			asm volatile("" ::: "memory");
+		}
+	};
+
+	// Spin-wait hint used while polling device registers.
+	// We do not use wfe here since device registers do not generate wake-up events.
+	inline void cpu_relax() {
+		asm volatile("yield" ::: "memory");
+	}
+
 	template<typename B>
 	struct mem_ops;
 
+	// The atomic operations are sequentially consistent (i.e., they have acquire and
+	// release semantics). If the compiler targets FEAT_LSE (e.g., -march=armv8.1-a),
+	// they use single LSE instructions, otherwise LL/SC loops.
+
 	template<>
-	struct mem_ops<uint8_t> {
+	struct mem_ops<uint8_t> : mem_barriers {
 		static uint8_t load(const uint8_t *p) {
 			uint8_t v;
 			asm volatile("ldrb %w[value], [%[src]]"
@@ -39,19 +66,128 @@ namespace _detail {
 				: : [value] "r"(v), [src] "r"(p));
 		}
 
-		static uint8_t atomic_exchange(uint64_t *p, uint8_t v) {
-			uint64_t t, s = 1;
-			while (s) {
-				asm volatile("ldxrb %w1, %2\n\tstxrb %w0, %w3, %2"
-						: "=&r"(s), "=&r"(t) : "m"(*p), "r"(v)
-						: "memory");
-			}
-			return t;
+		static uint8_t load_acquire(const uint8_t *p) {
+			uint8_t v;
+			asm volatile("ldarb %w[value], [%[src]]"
+				: [value] "=r"(v) : [src] "r"(p) : "memory");
+			return v;
+		}
+
+		static void store_release(uint8_t *p, uint8_t v) {
+			asm volatile("stlrb %w[value], [%[src]]"
+				: : [value] "r"(v), [src] "r"(p) : "memory");
+		}
+
+#if defined(__ARM_FEATURE_ATOMICS)
+		static uint8_t atomic_exchange(uint8_t *p, uint8_t v) {
+			uint8_t old;
+			asm volatile("swpalb %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint8_t *p, uint8_t &expected, uint8_t desired) {
+			uint8_t old = expected;
+			asm volatile("casalb %w[old], %w[desired], %[mem]"
+				: [old] "+r"(old), [mem] "+Q"(*p) : [desired] "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
 		}
+
+		static uint8_t atomic_fetch_add(uint8_t *p, uint8_t v) {
+			uint8_t old;
+			asm volatile("ldaddalb %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint8_t atomic_fetch_or(uint8_t *p, uint8_t v) {
+			uint8_t old;
+			asm volatile("ldsetalb %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint8_t atomic_fetch_and(uint8_t *p, uint8_t v) {
+			// ldclr clears the bits that are set in its operand.
+			uint8_t old;
+			asm volatile("ldclralb %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(static_cast<uint8_t>(~v)) : "memory");
+			return old;
+		}
+#else
+		static uint8_t atomic_exchange(uint8_t *p, uint8_t v) {
+			uint8_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrb %w[old], %[mem]\n\t"
+				"stlxrb %w[s], %w[v], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint8_t *p, uint8_t &expected, uint8_t desired) {
+			uint8_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrb %w[old], %[mem]\n\t"
+				"cmp %w[old], %w[expected], uxtb\n\t"
+				"b.ne 2f\n\t"
+				"stlxrb %w[s], %w[desired], %[mem]\n\t"
+				"cbnz %w[s], 1b\n\t"
+				"2:"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [expected] "r"(expected), [desired] "r"(desired) : "cc", "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint8_t atomic_fetch_add(uint8_t *p, uint8_t v) {
+			uint8_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrb %w[old], %[mem]\n\t"
+				"add %w[t], %w[old], %w[v]\n\t"
+				"stlxrb %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint8_t atomic_fetch_or(uint8_t *p, uint8_t v) {
+			uint8_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrb %w[old], %[mem]\n\t"
+				"orr %w[t], %w[old], %w[v]\n\t"
+				"stlxrb %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint8_t atomic_fetch_and(uint8_t *p, uint8_t v) {
+			uint8_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrb %w[old], %[mem]\n\t"
+				"and %w[t], %w[old], %w[v]\n\t"
+				"stlxrb %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+#endif
 	};
 
 	template<>
-	struct mem_ops<uint16_t> {
+	struct mem_ops<uint16_t> : mem_barriers {
 		static uint16_t load(const uint16_t *p) {
 			uint16_t v;
 			asm volatile("ldrh %w[value], [%[src]]"
@@ -78,19 +214,128 @@ namespace _detail {
 				: : [value] "r"(v), [src] "r"(p));
 		}
 
-		static uint16_t atomic_exchange(uint64_t *p, uint16_t v) {
-			uint64_t t, s = 1;
-			while (s) {
-				asm volatile("ldxrh %w1, %2\n\tstxrh %w0, %w3, %2"
-						: "=&r"(s), "=&r"(t) : "m"(*p), "r"(v)
-						: "memory");
-			}
-			return t;
+		static uint16_t load_acquire(const uint16_t *p) {
+			uint16_t v;
+			asm volatile("ldarh %w[value], [%[src]]"
+				: [value] "=r"(v) : [src] "r"(p) : "memory");
+			return v;
+		}
+
+		static void store_release(uint16_t *p, uint16_t v) {
+			asm volatile("stlrh %w[value], [%[src]]"
+				: : [value] "r"(v), [src] "r"(p) : "memory");
+		}
+
+#if defined(__ARM_FEATURE_ATOMICS)
+		static uint16_t atomic_exchange(uint16_t *p, uint16_t v) {
+			uint16_t old;
+			asm volatile("swpalh %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint16_t *p, uint16_t &expected, uint16_t desired) {
+			uint16_t old = expected;
+			asm volatile("casalh %w[old], %w[desired], %[mem]"
+				: [old] "+r"(old), [mem] "+Q"(*p) : [desired] "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint16_t atomic_fetch_add(uint16_t *p, uint16_t v) {
+			uint16_t old;
+			asm volatile("ldaddalh %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint16_t atomic_fetch_or(uint16_t *p, uint16_t v) {
+			uint16_t old;
+			asm volatile("ldsetalh %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint16_t atomic_fetch_and(uint16_t *p, uint16_t v) {
+			// ldclr clears the bits that are set in its operand.
+			uint16_t old;
+			asm volatile("ldclralh %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(static_cast<uint16_t>(~v)) : "memory");
+			return old;
+		}
+#else
+		static uint16_t atomic_exchange(uint16_t *p, uint16_t v) {
+			uint16_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrh %w[old], %[mem]\n\t"
+				"stlxrh %w[s], %w[v], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
 		}
+
+		static bool atomic_compare_exchange(uint16_t *p, uint16_t &expected, uint16_t desired) {
+			uint16_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrh %w[old], %[mem]\n\t"
+				"cmp %w[old], %w[expected], uxth\n\t"
+				"b.ne 2f\n\t"
+				"stlxrh %w[s], %w[desired], %[mem]\n\t"
+				"cbnz %w[s], 1b\n\t"
+				"2:"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [expected] "r"(expected), [desired] "r"(desired) : "cc", "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint16_t atomic_fetch_add(uint16_t *p, uint16_t v) {
+			uint16_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrh %w[old], %[mem]\n\t"
+				"add %w[t], %w[old], %w[v]\n\t"
+				"stlxrh %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint16_t atomic_fetch_or(uint16_t *p, uint16_t v) {
+			uint16_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrh %w[old], %[mem]\n\t"
+				"orr %w[t], %w[old], %w[v]\n\t"
+				"stlxrh %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint16_t atomic_fetch_and(uint16_t *p, uint16_t v) {
+			uint16_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxrh %w[old], %[mem]\n\t"
+				"and %w[t], %w[old], %w[v]\n\t"
+				"stlxrh %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+#endif
 	};
 
 	template<>
-	struct mem_ops<uint32_t> {
+	struct mem_ops<uint32_t> : mem_barriers {
 		static uint32_t load(const uint32_t *p) {
 			uint32_t v;
 			asm volatile("ldr %w[value], [%[src]]"
@@ -117,19 +362,128 @@ namespace _detail {
 				: : [value] "r"(v), [src] "r"(p));
 		}
 
-		static uint32_t atomic_exchange(uint64_t *p, uint32_t v) {
-			uint64_t t, s = 1;
-			while (s) {
-				asm volatile("ldxr %w1, %2\n\tstxr %w0, %w3, %2"
-						: "=&r"(s), "=&r"(t) : "m"(*p), "r"(v)
-						: "memory");
-			}
-			return t;
+		static uint32_t load_acquire(const uint32_t *p) {
+			uint32_t v;
+			asm volatile("ldar %w[value], [%[src]]"
+				: [value] "=r"(v) : [src] "r"(p) : "memory");
+			return v;
+		}
+
+		static void store_release(uint32_t *p, uint32_t v) {
+			asm volatile("stlr %w[value], [%[src]]"
+				: : [value] "r"(v), [src] "r"(p) : "memory");
+		}
+
+#if defined(__ARM_FEATURE_ATOMICS)
+		static uint32_t atomic_exchange(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile("swpal %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint32_t *p, uint32_t &expected, uint32_t desired) {
+			uint32_t old = expected;
+			asm volatile("casal %w[old], %w[desired], %[mem]"
+				: [old] "+r"(old), [mem] "+Q"(*p) : [desired] "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint32_t atomic_fetch_add(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile("ldaddal %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint32_t atomic_fetch_or(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile("ldsetal %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint32_t atomic_fetch_and(uint32_t *p, uint32_t v) {
+			// ldclr clears the bits that are set in its operand.
+			uint32_t old;
+			asm volatile("ldclral %w[v], %w[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(static_cast<uint32_t>(~v)) : "memory");
+			return old;
+		}
+#else
+		static uint32_t atomic_exchange(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %w[old], %[mem]\n\t"
+				"stlxr %w[s], %w[v], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint32_t *p, uint32_t &expected, uint32_t desired) {
+			uint32_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %w[old], %[mem]\n\t"
+				"cmp %w[old], %w[expected]\n\t"
+				"b.ne 2f\n\t"
+				"stlxr %w[s], %w[desired], %[mem]\n\t"
+				"cbnz %w[s], 1b\n\t"
+				"2:"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [expected] "r"(expected), [desired] "r"(desired) : "cc", "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint32_t atomic_fetch_add(uint32_t *p, uint32_t v) {
+			uint32_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %w[old], %[mem]\n\t"
+				"add %w[t], %w[old], %w[v]\n\t"
+				"stlxr %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint32_t atomic_fetch_or(uint32_t *p, uint32_t v) {
+			uint32_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %w[old], %[mem]\n\t"
+				"orr %w[t], %w[old], %w[v]\n\t"
+				"stlxr %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
 		}
+
+		static uint32_t atomic_fetch_and(uint32_t *p, uint32_t v) {
+			uint32_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %w[old], %[mem]\n\t"
+				"and %w[t], %w[old], %w[v]\n\t"
+				"stlxr %w[s], %w[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+#endif
 	};
 
 	template<>
-	struct mem_ops<uint64_t> {
+	struct mem_ops<uint64_t> : mem_barriers {
 		static uint64_t load(const uint64_t *p) {
 			uint64_t v;
 			asm volatile("ldr %[value], [%[src]]"
@@ -156,44 +510,301 @@ namespace _detail {
 				: : [value] "r"(v), [src] "r"(p));
 		}
 
+		static uint64_t load_acquire(const uint64_t *p) {
+			uint64_t v;
+			asm volatile("ldar %[value], [%[src]]"
+				: [value] "=r"(v) : [src] "r"(p) : "memory");
+			return v;
+		}
+
+		static void store_release(uint64_t *p, uint64_t v) {
+			asm volatile("stlr %[value], [%[src]]"
+				: : [value] "r"(v), [src] "r"(p) : "memory");
+		}
+
+#if defined(__ARM_FEATURE_ATOMICS)
 		static uint64_t atomic_exchange(uint64_t *p, uint64_t v) {
-			uint64_t t, s = 1;
-			while (s) {
-				asm volatile("ldxr %1, %2\n\tstxr %w0, %3, %2"
-						: "=&r"(s), "=&r"(t) : "m"(*p), "r"(v)
-						: "memory");
-			}
-			return t;
+			uint64_t old;
+			asm volatile("swpal %[v], %[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint64_t *p, uint64_t &expected, uint64_t desired) {
+			uint64_t old = expected;
+			asm volatile("casal %[old], %[desired], %[mem]"
+				: [old] "+r"(old), [mem] "+Q"(*p) : [desired] "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint64_t atomic_fetch_add(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile("ldaddal %[v], %[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint64_t atomic_fetch_or(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile("ldsetal %[v], %[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint64_t atomic_fetch_and(uint64_t *p, uint64_t v) {
+			// ldclr clears the bits that are set in its operand.
+			uint64_t old;
+			asm volatile("ldclral %[v], %[old], %[mem]"
+				: [old] "=r"(old), [mem] "+Q"(*p) : [v] "r"(static_cast<uint64_t>(~v)) : "memory");
+			return old;
+		}
+#else
+		static uint64_t atomic_exchange(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %[old], %[mem]\n\t"
+				"stlxr %w[s], %[v], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p) : [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint64_t *p, uint64_t &expected, uint64_t desired) {
+			uint64_t old;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %[old], %[mem]\n\t"
+				"cmp %[old], %[expected]\n\t"
+				"b.ne 2f\n\t"
+				"stlxr %w[s], %[desired], %[mem]\n\t"
+				"cbnz %w[s], 1b\n\t"
+				"2:"
+				: [old] "=&r"(old), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [expected] "r"(expected), [desired] "r"(desired) : "cc", "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint64_t atomic_fetch_add(uint64_t *p, uint64_t v) {
+			uint64_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %[old], %[mem]\n\t"
+				"add %[t], %[old], %[v]\n\t"
+				"stlxr %w[s], %[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
 		}
+
+		static uint64_t atomic_fetch_or(uint64_t *p, uint64_t v) {
+			uint64_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %[old], %[mem]\n\t"
+				"orr %[t], %[old], %[v]\n\t"
+				"stlxr %w[s], %[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+
+		static uint64_t atomic_fetch_and(uint64_t *p, uint64_t v) {
+			uint64_t old, t;
+			uint32_t s;
+			asm volatile("1:\n\t"
+				"ldaxr %[old], %[mem]\n\t"
+				"and %[t], %[old], %[v]\n\t"
+				"stlxr %w[s], %[t], %[mem]\n\t"
+				"cbnz %w[s], 1b"
+				: [old] "=&r"(old), [t] "=&r"(t), [s] "=&r"(s), [mem] "+Q"(*p)
+				: [v] "r"(v) : "memory");
+			return old;
+		}
+#endif
 	};
+
+	// 128-bit accesses use ldp and stp. For 16-byte aligned addresses, these are only
+	// single-copy atomic on CPUs that implement FEAT_LSE2 (mandatory since Armv8.4),
+	// hence this is only available if the target architecture guarantees FEAT_LSE2.
+	// Without it, use split_register for 128-bit registers.
+#if __ARM_ARCH >= 804
+	template<>
+	struct mem_ops<unsigned __int128> : mem_barriers {
+		static unsigned __int128 load(const unsigned __int128 *p) {
+			uint64_t lo, hi;
+			asm volatile("ldp %[lo], %[hi], [%[src]]"
+				: [lo] "=r"(lo), [hi] "=r"(hi) : [src] "r"(p) : "memory");
+			asm volatile("dsb ld" ::: "memory");
+			return (static_cast<unsigned __int128>(hi) << 64) | lo;
+		}
+
+		static void store(unsigned __int128 *p, unsigned __int128 v) {
+			asm volatile("dsb st" ::: "memory");
+			asm volatile("stp %[lo], %[hi], [%[dst]]"
+				: : [lo] "r"(static_cast<uint64_t>(v)), [hi] "r"(static_cast<uint64_t>(v >> 64)),
+					[dst] "r"(p) : "memory");
+		}
+
+		static unsigned __int128 load_relaxed(const unsigned __int128 *p) {
+			uint64_t lo, hi;
+			asm volatile("ldp %[lo], %[hi], [%[src]]"
+				: [lo] "=r"(lo), [hi] "=r"(hi) : [src] "r"(p));
+			return (static_cast<unsigned __int128>(hi) << 64) | lo;
+		}
+
+		static void store_relaxed(unsigned __int128 *p, unsigned __int128 v) {
+			asm volatile("stp %[lo], %[hi], [%[dst]]"
+				: : [lo] "r"(static_cast<uint64_t>(v)), [hi] "r"(static_cast<uint64_t>(v >> 64)),
+					[dst] "r"(p));
+		}
+	};
+#endif
+
+	// Stores a prefix of [src,src+size) to dst using accesses wider than 64 bits.
+	// The individual 16-byte accesses do not need to be single-copy atomic.
+	// Returns the number of bytes that were stored.
+	inline size_t store_burst_wide(void *dst, const void *src, size_t size) {
+		auto d = reinterpret_cast<uintptr_t>(dst);
+		auto s = static_cast<const char *>(src);
+		if (d & 15)
+			return 0;
+
+		size_t n = size & ~size_t(15);
+		for (size_t i = 0; i < n; i += 16) {
+			uint64_t lo, hi;
+			__builtin_memcpy(&lo, s + i, 8);
+			__builtin_memcpy(&hi, s + i + 8, 8);
+			asm volatile("stp %[lo], %[hi], [%[dst]]"
+				: : [lo] "r"(lo), [hi] "r"(hi), [dst] "r"(d + i) : "memory");
+		}
+		return n;
+	}
+
+	// Loads a prefix of [src,src+size) into dst using accesses wider than 64 bits.
+	// Returns the number of bytes that were loaded.
+	inline size_t load_burst_wide(void *dst, const void *src, size_t size) {
+		auto d = static_cast<char *>(dst);
+		auto s = reinterpret_cast<uintptr_t>(src);
+		if (s & 15)
+			return 0;
+
+		size_t n = size & ~size_t(15);
+		for (size_t i = 0; i < n; i += 16) {
+			uint64_t lo, hi;
+			asm volatile("ldp %[lo], %[hi], [%[src]]"
+				: [lo] "=r"(lo), [hi] "=r"(hi) : [src] "r"(s + i) : "memory");
+			__builtin_memcpy(d + i, &lo, 8);
+			__builtin_memcpy(d + i + 8, &hi, 8);
+		}
+		return n;
+	}
 }
 
 template<typename B>
 struct io_mem_ops {
+    static void before_load() {
+        asm volatile("" ::: "memory");
+    }
+    static void after_load() {
+        asm volatile("dmb oshld" ::: "memory");
+    }
+
+    static void before_store() {
+        asm volatile("dmb osh" ::: "memory");
+    }
+    static void after_store() {
+        asm volatile("" ::: "memory");
+    }
+
     static B load(const B *p) {
+        before_load();
         auto v = _detail::mem_ops<B>::load_relaxed(p);
-        asm volatile("dmb oshld" ::: "memory");
+        after_load();
         return v;
     }
 
     static void store(B *p, B v) {
-        asm volatile("dmb osh" ::: "memory");
+        before_store();
+        _detail::mem_ops<B>::store_relaxed(p, v);
+        after_store();
+    }
+
+    static B load_relaxed(const B *p) {
+        return _detail::mem_ops<B>::load_relaxed(p);
+    }
+
+    static void store_relaxed(B *p, B v) {
         _detail::mem_ops<B>::store_relaxed(p, v);
     }
+
+    // Only available if mem_ops<B> has them (i.e., not for 128-bit accesses),
+    // otherwise base_mem_space falls back to relaxed accesses and barriers.
+    static B load_acquire(const B *p)
+    requires requires (const B *q) { _detail::mem_ops<B>::load_acquire(q); } {
+        return _detail::mem_ops<B>::load_acquire(p);
+    }
+
+    static void store_release(B *p, B v)
+    requires requires (B *q, B w) { _detail::mem_ops<B>::store_release(q, w); } {
+        _detail::mem_ops<B>::store_release(p, v);
+    }
 };
 
 template<typename B>
 struct main_mem_ops {
+    static void before_load() {
+        asm volatile("" ::: "memory");
+    }
+    static void after_load() {
+        asm volatile("dmb ishld" ::: "memory");
+    }
+
+    static void before_store() {
+        asm volatile("dmb ish" ::: "memory");
+    }
+    static void after_store() {
+        asm volatile("" ::: "memory");
+    }
+
     static B load(const B *p) {
+        before_load();
         auto v = _detail::mem_ops<B>::load_relaxed(p);
-        asm volatile("dmb ishld" ::: "memory");
+        after_load();
         return v;
     }
 
     static void store(B *p, B v) {
-        asm volatile("dmb ish" ::: "memory");
+        before_store();
+        _detail::mem_ops<B>::store_relaxed(p, v);
+        after_store();
+    }
+
+    static B load_relaxed(const B *p) {
+        return _detail::mem_ops<B>::load_relaxed(p);
+    }
+
+    static void store_relaxed(B *p, B v) {
         _detail::mem_ops<B>::store_relaxed(p, v);
     }
+
+    // Only available if mem_ops<B> has them (i.e., not for 128-bit accesses),
+    // otherwise base_mem_space falls back to relaxed accesses and barriers.
+    static B load_acquire(const B *p)
+    requires requires (const B *q) { _detail::mem_ops<B>::load_acquire(q); } {
+        return _detail::mem_ops<B>::load_acquire(p);
+    }
+
+    static void store_release(B *p, B v)
+    requires requires (B *q, B w) { _detail::mem_ops<B>::store_release(q, w); } {
+        _detail::mem_ops<B>::store_release(p, v);
+    }
 };
 
 using _detail::mem_ops;
@@ -8,21 +8,79 @@
 namespace arch {
 
 namespace _detail {
+	// Data memory barrier for the outer shareable domain (i.e., including devices).
+	inline void dmb_osh() {
+#if __ARM_ARCH >= 7
+		asm volatile ("dmb osh" ::: "memory");
+#else
+		// ARMv6 only has the CP15 DMB operation, which applies to the entire system.
+		asm volatile ("mcr p15, 0, %0, c7, c10, 5" : : "r"(0) : "memory");
+#endif
+	}
+
+	// Barriers that are required around relaxed accesses to implement load() and store().
+	// There is no load-only variant of dmb, hence loads are followed by a full dmb osh.
+	struct mem_barriers {
+		static void before_load() {
+			asm volatile ("" ::: "memory");
+		}
+		static void after_load() {
+			dmb_osh();
+		}
+
+		static void before_store() {
+			dmb_osh();
+		}
+		static void after_store() {
+			asm volatile ("" ::: "memory");
+		}
+	};
+
+	// Spin-wait hint used while polling device registers.
+	inline void cpu_relax() {
+#if __ARM_ARCH >= 7
+		asm volatile ("yield" ::: "memory");
+#else
+		asm volatile ("" ::: "memory");
+#endif
+	}
+
 	template<typename B>
 	struct mem_ops;
 
+	// load_acquire() and store_release() in terms of relaxed accesses and barriers.
+	template<typename B>
+	struct acquire_release_ops {
+		static B load_acquire(const B *p) {
+			auto v = mem_ops<B>::load_relaxed(p);
+			acquire_release_barrier();
+			return v;
+		}
+
+		static void store_release(B *p, B v) {
+			acquire_release_barrier();
+			mem_ops<B>::store_relaxed(p, v);
+		}
+
+	private:
+		// io_mem_ops and main_mem_ops share mem_ops, hence this needs to order
+		// against devices (i.e., the outer shareable domain) as well.
+		static void acquire_release_barrier() {
+			dmb_osh();
+		}
+	};
+
 	template<>
-	struct mem_ops<uint8_t> {
+	struct mem_ops<uint8_t> : mem_barriers, acquire_release_ops<uint8_t> {
 		static uint8_t load(const uint8_t *p) {
-			uint8_t v;
-			asm volatile("ldrb %0, %1"
-				: "=l"(v) : "m"(*p) : "memory");
+			auto v = load_relaxed(p);
+			after_load();
 			return v;
 		}
 
 		static void store(uint8_t *p, uint8_t v) {
-			asm volatile("strb %0, %1"
-				: : "l"(v), "m"(*p) : "memory");
+			before_store();
+			store_relaxed(p, v);
 		}
 
 		static uint8_t load_relaxed(const uint8_t *p) {
@@ -49,17 +107,16 @@ namespace _detail {
 	};
 
 	template<>
-	struct mem_ops<uint16_t> {
+	struct mem_ops<uint16_t> : mem_barriers, acquire_release_ops<uint16_t> {
 		static uint16_t load(const uint16_t *p) {
-			uint16_t v;
-			asm volatile("ldrh %0, %1"
-				: "=l"(v) : "m"(*p) : "memory");
+			auto v = load_relaxed(p);
+			after_load();
 			return v;
 		}
 
 		static void store(uint16_t *p, uint16_t v) {
-			asm volatile("strh %0, %1"
-				: : "l"(v), "m"(*p) : "memory");
+			before_store();
+			store_relaxed(p, v);
 		}
 
 		static uint16_t load_relaxed(const uint16_t *p) {
@@ -86,17 +143,16 @@ namespace _detail {
 	};
 
 	template<>
-	struct mem_ops<uint32_t> {
+	struct mem_ops<uint32_t> : mem_barriers, acquire_release_ops<uint32_t> {
 		static uint32_t load(const uint32_t *p) {
-			uint32_t v;
-			asm volatile("ldr %0, %1"
-				: "=l"(v) : "m"(*p) : "memory");
+			auto v = load_relaxed(p);
+			after_load();
 			return v;
 		}
 
 		static void store(uint32_t *p, uint32_t v) {
-			asm volatile("str %0, %1"
-				: : "l"(v), "m"(*p) : "memory");
+			before_store();
+			store_relaxed(p, v);
 		}
 
 		static uint32_t load_relaxed(const uint32_t *p) {
@@ -121,18 +177,31 @@ namespace _detail {
 			return t;
 		}
 	};
+
+	// There are no single-copy atomic 64-bit accesses (without LPAE), hence there is
+	// no mem_ops<uint64_t>. 64-bit registers need to be accessed using split_register.
+
+	// Stores (or loads) a prefix of [src,src+size) to dst using accesses wider than the
+	// general purpose registers. There are no such accesses on this architecture.
+	inline size_t store_burst_wide(void *, const void *, size_t) {
+		return 0;
+	}
+
+	inline size_t load_burst_wide(void *, const void *, size_t) {
+		return 0;
+	}
 }
 
-// TODO: This is not correct.
+using _detail::mem_ops;
+
+// mem_ops uses outer shareable barriers, which are sufficient for both
+// device memory and main memory.
 template<typename B>
 using io_mem_ops = mem_ops<B>;
 
-// TODO: This is not correct.
 template<typename B>
 using main_mem_ops = mem_ops<B>;
 
-using _detail::mem_ops;
-
 } // namespace arch
 
 #endif // LIBARCH_MEM_SPACE_HPP
@@ -1,10 +1,63 @@
 #pragma once
 
+#include <assert.h>
+
 #include <arch/cache.hpp>
 #include <arch/dma_structs.hpp>
 
 namespace arch {
 
+namespace detail_ {
+
+// Element type of the typed DMA storage and view classes
+// and whether they contain an array or a single object.
+template<typename V>
+struct typed_dma { };
+
+template<typename T>
+struct typed_dma<dma_object_view<T>> {
+	using type = T;
+	static constexpr bool is_array = false;
+};
+
+template<typename T>
+struct typed_dma<dma_object<T>> {
+	using type = T;
+	static constexpr bool is_array = false;
+};
+
+template<typename T, typename Pool>
+struct typed_dma<static_dma_object<T, Pool>> {
+	using type = T;
+	static constexpr bool is_array = false;
+};
+
+template<typename T>
+struct typed_dma<dma_array_view<T>> {
+	using type = T;
+	static constexpr bool is_array = true;
+};
+
+template<typename T>
+struct typed_dma<dma_array<T>> {
+	using type = T;
+	static constexpr bool is_array = true;
+};
+
+template<typename T, typename Pool>
+struct typed_dma<static_dma_array<T, Pool>> {
+	using type = T;
+	static constexpr bool is_array = true;
+};
+
+template<typename V>
+concept typed_dma_memory = requires { typename typed_dma<V>::type; };
+
+template<typename V>
+concept typed_dma_array = typed_dma_memory<V> && typed_dma<V>::is_array;
+
+} // namespace detail_
+
 // Helper class for performing cache maintenance when doing DMA to potentially non-coherent
 // devices. Can be relaxed into no-ops when device is known to be cache-coherent. Typical use
 // cases would be as follows.
@@ -100,7 +153,135 @@ struct dma_barrier {
 		invalidate(reinterpret_cast<uintptr_t>(view.data()), view.size());
 	}
 
+
+	// Copy size bytes from src into memory that is read by the device.
+	// On non-coherent devices, this is equivalent to a copy followed by writeback()
+	// but it only passes over the destination once and avoids filling the cache with
+	// data that the CPU does not read again.
+	void copy_to_device(void *dst, const void *src, size_t size) const {
+		if (dma_coherent_) {
+			__builtin_memcpy(dst, src, size);
+			return;
+		}
+
+		cache_copy_writeback(dst, src, size);
+	}
+
+	void copy_to_device(arch::dma_buffer_view view, const void *src, size_t size) const {
+		assert(size <= view.size());
+		copy_to_device(view.data(), src, size);
+	}
+
+
+	// Batched variants of the functions above, e.g., for scatter-gather lists.
+	// Consecutive ranges that share cache lines are merged and only a single barrier
+	// is issued for the entire batch.
+
+	void writeback(std::span<const cache_range> ranges) const {
+		if (dma_coherent_) return;
+
+		cache_writeback(ranges);
+	}
+
+	void clean_or_invalidate(std::span<const cache_range> ranges) const {
+		if (dma_coherent_) return;
+
+		cache_clean_or_invalidate(ranges);
+	}
+
+	void invalidate(std::span<const cache_range> ranges) const {
+		if (dma_coherent_) return;
+
+		cache_invalidate(ranges);
+	}
+
+
+	void writeback(std::span<const arch::dma_buffer_view> views) const {
+		if (dma_coherent_) return;
+
+		default_cache_ops::maintain_batch<detail_::writeback_op>(views, view_range_);
+	}
+
+	void clean_or_invalidate(std::span<const arch::dma_buffer_view> views) const {
+		if (dma_coherent_) return;
+
+		default_cache_ops::maintain_batch<detail_::clean_or_invalidate_op>(views, view_range_);
+	}
+
+	void invalidate(std::span<const arch::dma_buffer_view> views) const {
+		if (dma_coherent_) return;
+
+		default_cache_ops::maintain_batch<detail_::invalidate_op>(views, view_range_);
+	}
+
+	// Overloads for dma_object(_view)<T> and dma_array(_view)<T> (and the static_dma_*
+	// variants). For objects, sizeof(T) is passed to the cache maintenance as a compile-time
+	// size; if LIBARCH_CACHE_LINE_SIZE is set, this reduces objects that fit into a line
+	// to at most two maintenance instructions.
+	// The variants that take an index only maintain the n-th element of an array
+	// (e.g., a single entry of a descriptor ring).
+
+	template<detail_::typed_dma_memory V>
+	void writeback(const V &v) const {
+		typed_<detail_::writeback_op>(v);
+	}
+
+	template<detail_::typed_dma_array V>
+	void writeback(const V &v, size_t n) const {
+		assert(n < v.size());
+		object_<detail_::writeback_op>(v.data() + n);
+	}
+
+	template<detail_::typed_dma_memory V>
+	void clean_or_invalidate(const V &v) const {
+		typed_<detail_::clean_or_invalidate_op>(v);
+	}
+
+	template<detail_::typed_dma_array V>
+	void clean_or_invalidate(const V &v, size_t n) const {
+		assert(n < v.size());
+		object_<detail_::clean_or_invalidate_op>(v.data() + n);
+	}
+
+	template<detail_::typed_dma_memory V>
+	void invalidate(const V &v) const {
+		typed_<detail_::invalidate_op>(v);
+	}
+
+	template<detail_::typed_dma_array V>
+	void invalidate(const V &v, size_t n) const {
+		assert(n < v.size());
+		object_<detail_::invalidate_op>(v.data() + n);
+	}
+
 private:
+	template<typename Op, typename V>
+	void typed_(const V &v) const {
+		if constexpr (detail_::typed_dma<V>::is_array) {
+			array_<Op>(v.data(), v.size());
+		} else {
+			object_<Op>(v.data());
+		}
+	}
+
+	template<typename Op, typename T>
+	void object_(const T *p) const {
+		if (dma_coherent_) return;
+
+		default_cache_ops::maintain<Op, sizeof(T)>(reinterpret_cast<uintptr_t>(p));
+	}
+
+	template<typename Op, typename T>
+	void array_(const T *p, size_t n) const {
+		if (dma_coherent_) return;
+
+		default_cache_ops::maintain<Op>(reinterpret_cast<uintptr_t>(p), sizeof(T) * n);
+	}
+
+	static cache_range view_range_(const arch::dma_buffer_view &view) {
+		return {reinterpret_cast<uintptr_t>(view.data()), view.size()};
+	}
+
 	bool dma_coherent_;
 };
 
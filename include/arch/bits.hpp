@@ -1,14 +1,24 @@
 #ifndef LIBARCH_BITS_HPP
 #define LIBARCH_BITS_HPP
 
+#include <assert.h>
+#include <type_traits>
+
 namespace arch {
 
+namespace _details {
+
+// Not constexpr: calling this during constant evaluation is a compile error.
+inline void invalid_field() { }
+
+} // namespace _details
+
 template<typename B>
 struct bit_mask {
-	explicit bit_mask(B bits)
+	explicit constexpr bit_mask(B bits)
 	: _bits(bits) { }
 
-	explicit operator B () {
+	explicit constexpr operator B () const {
 		return _bits;
 	}
 
@@ -19,43 +29,43 @@ private:
 // represents a fixed size vector of bits with a value mask.
 template<typename B>
 struct masked_bit_value {
-	explicit masked_bit_value(B bits, B mask)
+	explicit constexpr masked_bit_value(B bits, B mask)
 	: _bits(bits), _mask(mask) { }
 
-	explicit operator B () {
+	explicit constexpr operator B () const {
 		return _bits;
 	}
 
-	B mask() const {
+	constexpr B mask() const {
 		return _mask;
 	}
 
-	B bits() const {
+	constexpr B bits() const {
 		return _bits;
 	}
 
 	// allow building a value from multiple bit vectors.
-	masked_bit_value operator| (masked_bit_value other) const {
+	constexpr masked_bit_value operator| (masked_bit_value other) const {
 		return masked_bit_value(_bits | other.bits(), _mask | other.mask());
 	}
-	masked_bit_value &operator|= (masked_bit_value other) {
+	constexpr masked_bit_value &operator|= (masked_bit_value other) {
 		*this = *this | other;
 		return *this;
 	}
 
 	// allow masking out individual bits.
-	masked_bit_value operator& (bit_mask<B> other) const {
+	constexpr masked_bit_value operator& (bit_mask<B> other) const {
 		return masked_bit_value(_bits & static_cast<B>(other), _mask & ~static_cast<B>(other));
 	}
-	masked_bit_value &operator&= (bit_mask<B> other) {
+	constexpr masked_bit_value &operator&= (bit_mask<B> other) {
 		*this = *this & other;
 		return *this;
 	}
 
-	masked_bit_value operator/ (masked_bit_value other) const {
+	constexpr masked_bit_value operator/ (masked_bit_value other) const {
 		return masked_bit_value((_bits & ~other.mask()) | other.bits(), _mask);
 	}
-	masked_bit_value &operator/= (masked_bit_value other) {
+	constexpr masked_bit_value &operator/= (masked_bit_value other) {
 		*this = *this / other;
 		return *this;
 	}
@@ -68,53 +78,53 @@ private:
 // represents a fixed size vector of bits.
 template<typename B>
 struct bit_value {
-	explicit bit_value(B bits)
+	explicit constexpr bit_value(B bits)
 	: _bits(bits) { }
 
-	explicit operator B () {
+	explicit constexpr operator B () const {
 		return _bits;
 	}
 
-	bit_value(masked_bit_value<B> v)
+	constexpr bit_value(masked_bit_value<B> v)
 	: _bits{v.bits()} { }
 
 	// allow building a value from multiple bit vectors.
-	bit_value operator| (bit_value other) const {
+	constexpr bit_value operator| (bit_value other) const {
 		return bit_value(_bits | other._bits);
 	}
-	bit_value &operator|= (bit_value other) {
+	constexpr bit_value &operator|= (bit_value other) {
 		*this = *this | other;
 		return *this;
 	}
 
 	// allow building a value from multiple bit vectors.
-	bit_value operator| (masked_bit_value<B> other) const {
+	constexpr bit_value operator| (masked_bit_value<B> other) const {
 		return bit_value(_bits | other.bits());
 	}
-	bit_value &operator|= (masked_bit_value<B> other) {
+	constexpr bit_value &operator|= (masked_bit_value<B> other) {
 		*this = *this | other;
 		return *this;
 	}
 
 	// allow masking out individual bits.
-	bit_value operator& (bit_mask<B> other) const {
+	constexpr bit_value operator& (bit_mask<B> other) const {
 		return bit_value(_bits & static_cast<B>(other));
 	}
-	bit_value &operator&= (bit_mask<B> other) {
+	constexpr bit_value &operator&= (bit_mask<B> other) {
 		*this = *this & other;
 		return *this;
 	}
 
 	// combined masking out and building values
-	bit_value operator/ (masked_bit_value<B> other) const {
+	constexpr bit_value operator/ (masked_bit_value<B> other) const {
 		return bit_value((_bits & ~other.mask()) | other.bits());
 	}
-	bit_value &operator/= (masked_bit_value<B> other) {
+	constexpr bit_value &operator/= (masked_bit_value<B> other) {
 		*this = *this / other;
 		return *this;
 	}
 
-	bit_value operator~ () const {
+	constexpr bit_value operator~ () const {
 		return bit_value(~_bits);
 	}
 
@@ -125,27 +135,52 @@ private:
 template<typename B, typename T>
 struct field {
 	// allow extraction of individual fields from bit vectors.
-	friend T operator& (bit_value<B> bv, field f) {
+	friend constexpr T operator& (bit_value<B> bv, field f) {
 		return static_cast<T>((static_cast<B>(bv) >> f._shift) & f._mask);
 	}
 
 	explicit constexpr field(int shift, int num_bits)
-	: _shift(shift), _mask((B(1) << num_bits) - 1) { }
-
-	masked_bit_value<B> operator() (T value) const {
+	: _shift(0), _mask(0) {
+		// Fields that do not fit into B are rejected at compile time and by an assertion
+		// at run time. If assertions are disabled, they behave like empty fields.
+		if (num_bits < 1 || shift < 0 || shift + num_bits > static_cast<int>(sizeof(B) * 8)) {
+			if (std::is_constant_evaluated())
+				_details::invalid_field();
+			assert(!"field does not fit into B");
+			return;
+		}
+		_shift = shift;
+		// Shifting by num_bits - 1 first keeps fields that cover all bits of B well-defined.
+		_mask = ((B(1) << (num_bits - 1)) << 1) - 1;
+	}
+
+	constexpr masked_bit_value<B> operator() (T value) const {
 		return masked_bit_value<B>((static_cast<B>(value) & _mask) << _shift, _mask << _shift);
 	}
 
 	// allow inversion of this field to a bit mask.
-	bit_mask<B> operator~ () const {
+	constexpr bit_mask<B> operator~ () const {
 		return bit_mask<B>(~(_mask << _shift));
 	}
 
+	// Bits that are covered by this field.
+	constexpr B mask() const {
+		return _mask << _shift;
+	}
+
 private:
 	int _shift;
 	B _mask;
 };
 
+// Folds a set of field values into a single value. Bits that are not covered by
+// any field are zero. For example:
+//   constexpr auto cmd = arch::make_bit_value(ctrl::enable(true), ctrl::mode(3));
+template<typename B, typename... Ts>
+constexpr bit_value<B> make_bit_value(masked_bit_value<B> v, Ts... vs) {
+	return bit_value<B>{(v | ... | masked_bit_value<B>{vs})};
+}
+
 } // namespace arch
 
 #endif // LIBARCH_BITS_HPP
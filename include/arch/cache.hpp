@@ -1,3 +1,10 @@
+#pragma once
+
+#include <assert.h>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
 #if defined(__i386__) || defined(__x86_64__)
 #	include <arch/x86/cache.hpp>
 #elif defined(__aarch64__)
@@ -7,3 +14,281 @@
 #else
 #	error Unsupported architecture
 #endif
+
+// Cache line size that is known at build time (e.g., set by the cache_line_size meson option).
+// Zero means that the line size is determined at run time.
+#ifndef LIBARCH_CACHE_LINE_SIZE
+#	define LIBARCH_CACHE_LINE_SIZE 0
+#endif
+
+namespace arch {
+
+struct cache_range {
+	uintptr_t addr;
+	size_t size;
+};
+
+namespace detail_ {
+
+template<typename Op, size_t L>
+[[gnu::always_inline]] inline void cache_maintain(uintptr_t addr, size_t size) {
+	if (Op::try_whole(size))
+		return;
+	Op::template lines<L>(addr, size);
+	Op::fence();
+}
+
+// Performs Op on [addr,addr+Size) where both the line size and the size are constants.
+template<typename Op, size_t L, size_t Size>
+[[gnu::always_inline]] inline void cache_maintain_fixed(uintptr_t addr) {
+	if constexpr (L && Size && Size <= L) {
+		// The object spans either one or two lines.
+		auto first = addr & ~(L - 1);
+		auto last = (addr + Size - 1) & ~(L - 1);
+		Op::template lines<L>(first, 1);
+		if (last != first)
+			Op::template lines<L>(last, 1);
+	} else {
+		Op::template lines<L>(addr, Size);
+	}
+	Op::fence();
+}
+
+// Line-aligned range [begin,end) that cache_maintain_batch() still needs to maintain.
+struct line_run {
+	uintptr_t begin;
+	uintptr_t end;
+};
+
+// Number of line runs that cache_maintain_batch() sorts and merges at once.
+inline constexpr size_t max_line_runs = 16;
+
+// Sorts runs[0,n) by address and performs Op once on each maximal union of
+// overlapping or adjacent runs.
+template<typename Op, size_t L>
+void maintain_line_runs(line_run *runs, size_t n) {
+	for (size_t i = 1; i < n; i++) {
+		auto run = runs[i];
+		size_t j = i;
+		for (; j && runs[j - 1].begin > run.begin; j--)
+			runs[j] = runs[j - 1];
+		runs[j] = run;
+	}
+	size_t i = 0;
+	while (i < n) {
+		auto begin = runs[i].begin;
+		auto end = runs[i].end;
+		for (i++; i < n && runs[i].begin <= end; i++) {
+			if (runs[i].end > end)
+				end = runs[i].end;
+		}
+		Op::template lines<L>(begin, end - begin);
+	}
+}
+
+// Performs Op on the ranges proj(r) for all r in ranges, followed by a single fence.
+// Ranges are rounded to cache lines and merged, such that each line is only maintained once,
+// even if it is covered by multiple (not necessarily consecutive) ranges.
+// Runs are sorted in batches of max_line_runs; lines that are covered by ranges
+// in different batches (i.e., in scatter lists with more distinct runs) may be maintained
+// more than once.
+template<typename Op, size_t L, typename R, typename Proj>
+void cache_maintain_batch(const R &ranges, Proj proj) {
+	size_t total = 0;
+	for (const auto &r : ranges)
+		total += proj(r).size;
+	if (Op::try_whole(total))
+		return;
+
+	size_t dsz = L ? L : dcache_line_size();
+	line_run runs[max_line_runs];
+	size_t n = 0;
+	for (const auto &r : ranges) {
+		cache_range cr = proj(r);
+		if (!cr.size)
+			continue;
+		auto begin = cr.addr & ~(dsz - 1);
+		auto end = (cr.addr + cr.size + dsz - 1) & ~(dsz - 1);
+		// Fast path: extend the previous run if the ranges overlap or touch.
+		if (n && begin <= runs[n - 1].end && end >= runs[n - 1].begin) {
+			if (begin < runs[n - 1].begin)
+				runs[n - 1].begin = begin;
+			if (end > runs[n - 1].end)
+				runs[n - 1].end = end;
+			continue;
+		}
+		if (n == max_line_runs) {
+			maintain_line_runs<Op, L>(runs, n);
+			n = 0;
+		}
+		runs[n++] = {begin, end};
+	}
+	maintain_line_runs<Op, L>(runs, n);
+	Op::fence();
+}
+
+inline cache_range identity_range(cache_range r) {
+	return r;
+}
+
+// copy() copies a range and writes it back using WritebackOp without a trailing barrier.
+// Each line is written back right after copying it (while it is still hot in the cache)
+// instead of doing a second pass over the range.
+// This is used by architectures that do not provide non-temporal stores.
+template<typename WritebackOp>
+struct copy_then_writeback_op {
+	template<size_t L = 0>
+	static void copy(void *dst, const void *src, size_t size) {
+		size_t dsz = L ? L : dcache_line_size();
+		auto d = reinterpret_cast<uintptr_t>(dst);
+		auto s = static_cast<const char *>(src);
+		size_t done = 0;
+		while (done < size) {
+			auto chunk = dsz - ((d + done) & (dsz - 1));
+			if (chunk > size - done)
+				chunk = size - done;
+			__builtin_memcpy(reinterpret_cast<void *>(d + done), s + done, chunk);
+			WritebackOp::template lines<L>(d + done, chunk);
+			done += chunk;
+		}
+	}
+
+	static void fence() {
+		WritebackOp::fence();
+	}
+};
+
+} // namespace detail_
+
+// Cache maintenance for a cache line size L that is known at compile time.
+// L must not be larger than the actual cache line size of the CPU (smaller values are
+// safe but result in redundant instructions). If L is zero, the line size is
+// determined at run time.
+//
+// The variants that take the size as a template argument are intended for small
+// objects such as descriptors; for Size <= L they compile down to at most two cache
+// maintenance instructions. They never fall back to whole cache maintenance.
+template<size_t L>
+struct cache_ops {
+	static_assert(!(L & (L - 1)), "cache line size must be a power of two");
+
+	static constexpr size_t line_size = L;
+
+	static void writeback(uintptr_t addr, size_t size) {
+		check_line_size_();
+		detail_::cache_maintain<detail_::writeback_op, L>(addr, size);
+	}
+
+	static void clean_or_invalidate(uintptr_t addr, size_t size) {
+		check_line_size_();
+		detail_::cache_maintain<detail_::clean_or_invalidate_op, L>(addr, size);
+	}
+
+	static void invalidate(uintptr_t addr, size_t size) {
+		check_line_size_();
+		detail_::cache_maintain<detail_::invalidate_op, L>(addr, size);
+	}
+
+	template<size_t Size>
+	[[gnu::always_inline]] static void writeback(uintptr_t addr) {
+		check_line_size_();
+		detail_::cache_maintain_fixed<detail_::writeback_op, L, Size>(addr);
+	}
+
+	template<size_t Size>
+	[[gnu::always_inline]] static void clean_or_invalidate(uintptr_t addr) {
+		check_line_size_();
+		detail_::cache_maintain_fixed<detail_::clean_or_invalidate_op, L, Size>(addr);
+	}
+
+	template<size_t Size>
+	[[gnu::always_inline]] static void invalidate(uintptr_t addr) {
+		check_line_size_();
+		detail_::cache_maintain_fixed<detail_::invalidate_op, L, Size>(addr);
+	}
+
+	// Copies size bytes from src to dst and writes dst back to memory.
+	// This avoids a second pass over dst (and, where the architecture supports it,
+	// avoids polluting the cache with data that the CPU does not read again).
+	static void copy_writeback(void *dst, const void *src, size_t size) {
+		check_line_size_();
+		detail_::copy_writeback_op::copy<L>(dst, src, size);
+		detail_::copy_writeback_op::fence();
+	}
+
+	static void writeback(std::span<const cache_range> ranges) {
+		maintain_batch<detail_::writeback_op>(ranges, detail_::identity_range);
+	}
+
+	static void clean_or_invalidate(std::span<const cache_range> ranges) {
+		maintain_batch<detail_::clean_or_invalidate_op>(ranges, detail_::identity_range);
+	}
+
+	static void invalidate(std::span<const cache_range> ranges) {
+		maintain_batch<detail_::invalidate_op>(ranges, detail_::identity_range);
+	}
+
+	// Generic variants of the functions above that take the maintenance operation Op
+	// (one of the detail_::*_op types) as a template argument.
+
+	template<typename Op>
+	static void maintain(uintptr_t addr, size_t size) {
+		check_line_size_();
+		detail_::cache_maintain<Op, L>(addr, size);
+	}
+
+	template<typename Op, size_t Size>
+	[[gnu::always_inline]] static void maintain(uintptr_t addr) {
+		check_line_size_();
+		detail_::cache_maintain_fixed<Op, L, Size>(addr);
+	}
+
+	// Performs Op on the cache_ranges proj(r) of all elements r of ranges
+	// (e.g., of dma_buffer_views).
+	template<typename Op, typename R, typename Proj>
+	static void maintain_batch(const R &ranges, Proj proj) {
+		check_line_size_();
+		detail_::cache_maintain_batch<Op, L>(ranges, proj);
+	}
+
+private:
+	static void check_line_size_() {
+		if constexpr (L)
+			assert(L <= detail_::dcache_line_size());
+	}
+};
+
+using default_cache_ops = cache_ops<LIBARCH_CACHE_LINE_SIZE>;
+
+inline void cache_writeback(uintptr_t addr, size_t size) {
+	default_cache_ops::writeback(addr, size);
+}
+
+inline void cache_clean_or_invalidate(uintptr_t addr, size_t size) {
+	default_cache_ops::clean_or_invalidate(addr, size);
+}
+
+inline void cache_invalidate(uintptr_t addr, size_t size) {
+	default_cache_ops::invalidate(addr, size);
+}
+
+inline void cache_copy_writeback(void *dst, const void *src, size_t size) {
+	default_cache_ops::copy_writeback(dst, src, size);
+}
+
+// Batched variants of the functions above. These only issue a single barrier
+// after all ranges have been maintained.
+
+inline void cache_writeback(std::span<const cache_range> ranges) {
+	default_cache_ops::writeback(ranges);
+}
+
+inline void cache_clean_or_invalidate(std::span<const cache_range> ranges) {
+	default_cache_ops::clean_or_invalidate(ranges);
+}
+
+inline void cache_invalidate(std::span<const cache_range> ranges) {
+	default_cache_ops::invalidate(ranges);
+}
+
+} // namespace arch
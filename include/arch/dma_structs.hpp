@@ -2,9 +2,12 @@
 #define LIBARCH_DMA_HPP
 
 #include <assert.h>
+#include <concepts>
 #include <cstddef>
+#include <iterator>
 #include <new>
 #include <optional>
+#include <span>
 #include <stdint.h>
 #include <utility>
 
@@ -51,11 +54,65 @@ struct dma_region {
 		return reinterpret_cast<T *>(get_base_va() + offset);
 	}
 
+	// Whether devices can access the region (i.e., whether its bus address is known).
+	bool has_bus_address() const {
+		return base_bus_address || !bus_chunks.empty();
+	}
+
+	// Returns the address that devices use to access the given offset.
+	// Returns std::nullopt if the region has no bus address (e.g., host_dma_region)
+	// or if the offset is not covered by bus_chunks.
+	std::optional<uint64_t> get_bus_address(size_t offset) const {
+		if (!bus_chunks.empty()) {
+			auto idx = offset >> bus_chunk_shift;
+			if (idx >= bus_chunks.size())
+				return std::nullopt;
+			return bus_chunks[idx] + (offset & ((size_t(1) << bus_chunk_shift) - 1));
+		}
+		if (!base_bus_address)
+			return std::nullopt;
+		return *base_bus_address + offset;
+	}
+
+	// Returns the largest n <= size such that [offset, offset + n) is contiguous on the bus.
+	size_t get_bus_contiguous_size(size_t offset, size_t size) const {
+		if (bus_chunks.empty())
+			return size;
+		auto chunk_size = size_t(1) << bus_chunk_shift;
+		auto idx = offset >> bus_chunk_shift;
+		size_t n = chunk_size - (offset & (chunk_size - 1));
+		while (n < size) {
+			if (idx + 1 >= bus_chunks.size()
+					|| bus_chunks[idx + 1] != bus_chunks[idx] + chunk_size)
+				break;
+			idx++;
+			n += chunk_size;
+		}
+		return n < size ? n : size;
+	}
+
 protected:
+	// Copies the virtual and bus addresses of another region
+	// (e.g., for regions that alias regions of other pools).
+	void inherit_mapping(const dma_region &other) {
+		base_va = other.base_va;
+		base_bus_address = other.base_bus_address;
+		bus_chunks = other.bus_chunks;
+		bus_chunk_shift = other.bus_chunk_shift;
+	}
+
 	// Whether this region is valid. Only null_dma_region is invalid.
 	bool valid{true};
 	// Virtual address where the region is mapped (if it is mapped).
 	std::optional<uintptr_t> base_va;
+	// Bus address of offset zero if the region is contiguous on the bus.
+	std::optional<uint64_t> base_bus_address;
+	// Otherwise, bus addresses of chunks of 2^bus_chunk_shift bytes each,
+	// i.e., bus_chunks[i] is the bus address of offset i << bus_chunk_shift.
+	// The span does not own the table and inherit_mapping() copies the span (not the table),
+	// hence the table must outlive this region and all regions that inherit its mapping.
+	std::span<const uint64_t> bus_chunks;
+	unsigned int bus_chunk_shift{0};
 
 private:
 	dma_pool *pool_;
@@ -97,11 +154,11 @@ struct dma_ptr {
 		return _region->pool();
 	}
 
-	dma_region *region() {
+	dma_region *region() const {
 		return _region;
 	}
 
-	size_t offset() {
+	size_t offset() const {
 		return _offset;
 	}
 
@@ -110,6 +167,11 @@ struct dma_ptr {
 		return _region->get_raw_ptr<T>(_offset);
 	}
 
+	// See dma_region::get_bus_address().
+	std::optional<uint64_t> bus_address() const {
+		return _region->get_bus_address(_offset);
+	}
+
 	dma_ptr offset_by(size_t off) const {
 		return {_region, _offset + off};
 	}
@@ -125,11 +187,141 @@ inline dma_ptr make_host_dma_ptr(void *p) {
 	return {&host_dma_region, reinterpret_cast<uintptr_t>(p)};
 }
 
+// Contiguous range of the bus address space.
+struct dma_segment {
+	uint64_t bus_address;
+	size_t size;
+};
+
+// Iterates over the maximal bus-contiguous dma_segments of a range of a dma_region.
+struct dma_segment_iterator {
+	using value_type = dma_segment;
+	using difference_type = std::ptrdiff_t;
+
+	dma_segment_iterator() = default;
+
+	dma_segment_iterator(const dma_region *region, size_t offset, size_t size)
+	: _region{region}, _offset{offset}, _remaining{size} {
+		_update();
+	}
+
+	dma_segment operator* () const {
+		return _segment;
+	}
+
+	dma_segment_iterator &operator++ () {
+		_offset += _segment.size;
+		_remaining -= _segment.size;
+		_update();
+		return *this;
+	}
+
+	dma_segment_iterator operator++ (int) {
+		auto copy = *this;
+		++*this;
+		return copy;
+	}
+
+	friend bool operator== (const dma_segment_iterator &it, std::default_sentinel_t) {
+		return !it._remaining;
+	}
+
+	// Number of bytes at the end of the range that have no bus address
+	// (and that are hence not covered by any segment). Only meaningful at the end.
+	size_t unmapped() const {
+		return _unmapped;
+	}
+
+private:
+	void _update() {
+		if (!_remaining)
+			return;
+		auto bus_address = _region->get_bus_address(_offset);
+		if (!bus_address) {
+			// Iteration stops at the first byte without a bus address.
+			_unmapped = _remaining;
+			_remaining = 0;
+			return;
+		}
+		_segment.bus_address = *bus_address;
+		_segment.size = _region->get_bus_contiguous_size(_offset, _remaining);
+	}
+
+	const dma_region *_region{nullptr};
+	size_t _offset{0};
+	size_t _remaining{0};
+	size_t _unmapped{0};
+	dma_segment _segment{0, 0};
+};
+
+struct dma_segment_range {
+	explicit dma_segment_range(dma_segment_iterator begin)
+	: _begin{begin} { }
+
+	dma_segment_iterator begin() const {
+		return _begin;
+	}
+
+	std::default_sentinel_t end() const {
+		return {};
+	}
+
+	// Number of bytes at the end of the range that are not covered by any segment since
+	// they have no bus address (e.g., the entire range for host_dma_region, or the part
+	// of the range that exceeds the region's bus_chunks). A device that is programmed
+	// with the segments of an incomplete range would only transfer a prefix of it.
+	size_t unmapped() const {
+		auto it = _begin;
+		while (it != end())
+			++it;
+		return it.unmapped();
+	}
+
+	// Whether the segments cover the entire range.
+	bool complete() const {
+		return !unmapped();
+	}
+
+private:
+	dma_segment_iterator _begin;
+};
+
 struct dma_pool {
 	virtual ~dma_pool() = default;
 
 	virtual dma_ptr allocate(size_t size, size_t count, size_t align) = 0;
 	virtual void deallocate(dma_ptr ptr, size_t size, size_t count, size_t align) = 0;
+
+	// Allocates ptrs.size() independent blocks (each of which is equivalent to
+	// allocate(size, count, align)). Returns the number n of blocks that could be allocated;
+	// these are stored in ptrs[0, n). Pools should override this to amortize locking.
+	virtual size_t allocate_bulk(std::span<dma_ptr> ptrs, size_t size, size_t count, size_t align) {
+		size_t n = 0;
+		while (n < ptrs.size()) {
+			auto ptr = allocate(size, count, align);
+			if (!ptr)
+				break;
+			ptrs[n++] = ptr;
+		}
+		return n;
+	}
+
+	// Frees blocks that were allocated with the same size, count and align.
+	// Null pointers are ignored.
+	virtual void deallocate_bulk(std::span<const dma_ptr> ptrs, size_t size, size_t count, size_t align) {
+		for (auto ptr : ptrs) {
+			if (ptr)
+				deallocate(ptr, size, count, align);
+		}
+	}
+};
+
+// Pool types that can be used with the static_dma_* storage classes.
+// If the type is final, calls through a pointer to it are not virtual.
+template<typename Pool>
+concept dma_pool_type = requires(Pool *self, size_t size, size_t count, size_t align, dma_ptr ptr) {
+	{ self->allocate(size, count, align) } -> std::same_as<dma_ptr>;
+	{ self->deallocate(ptr, size, count, align) } -> std::same_as<void>;
 };
 
 // ----------------------------------------------------------------------------
@@ -173,6 +365,16 @@ struct dma_buffer_view {
 		return _ptr;
 	}
 
+	std::optional<uint64_t> bus_address() const {
+		return _ptr.bus_address();
+	}
+
+	// Maximal bus-contiguous segments of the buffer (e.g., to build scatter lists).
+	// Iteration stops at the first byte without a bus address; see dma_segment_range::complete().
+	dma_segment_range segments() const {
+		return dma_segment_range{dma_segment_iterator{_ptr.region(), _ptr.offset(), _size}};
+	}
+
 	dma_buffer_view subview(size_t offset, size_t chunk) const {
 		assert(offset <= _size);
 		assert(offset + chunk <= _size);
@@ -333,7 +535,74 @@ struct dma_buffer {
 		return _ptr;
 	}
 
+	// Allocates a buffer of the given size for each (empty) element of buffers
+	// using a single allocate_bulk() call. Returns the number n of buffers that could be
+	// allocated; these are stored in buffers[0, n).
+	static size_t allocate_bulk(dma_pool *pool, std::span<dma_buffer> buffers, size_t size) {
+		dma_ptr ptrs[_bulk_chunk];
+		size_t n = 0;
+		while (n < buffers.size()) {
+			auto chunk = buffers.size() - n;
+			if (chunk > _bulk_chunk)
+				chunk = _bulk_chunk;
+
+			size_t k;
+			if(pool) {
+				k = pool->allocate_bulk(std::span{ptrs, chunk}, size, 1, 1);
+			}else{
+				for (k = 0; k < chunk; k++)
+					ptrs[k] = make_host_dma_ptr(operator new(size));
+			}
+			for (size_t i = 0; i < k; i++) {
+				assert(!buffers[n + i]._ptr);
+				buffers[n + i]._ptr = ptrs[i];
+				buffers[n + i]._size = size;
+			}
+			n += k;
+			if (k < chunk)
+				break;
+		}
+		return n;
+	}
+
+	// Frees all buffers. Consecutive buffers of the same pool and size
+	// are freed using a single deallocate_bulk() call.
+	static void deallocate_bulk(std::span<dma_buffer> buffers) {
+		dma_ptr ptrs[_bulk_chunk];
+		size_t i = 0;
+		while (i < buffers.size()) {
+			if (!buffers[i]._ptr) {
+				i++;
+				continue;
+			}
+			auto pool = buffers[i]._ptr.pool();
+			auto size = buffers[i]._size;
+			if(!pool) {
+				operator delete(buffers[i].data(), size);
+				buffers[i]._ptr = dma_ptr{};
+				buffers[i]._size = 0;
+				i++;
+				continue;
+			}
+
+			size_t k = 0;
+			while (i < buffers.size() && k < _bulk_chunk
+					&& buffers[i]._ptr
+					&& buffers[i]._ptr.pool() == pool
+					&& buffers[i]._size == size) {
+				ptrs[k++] = buffers[i]._ptr;
+				buffers[i]._ptr = dma_ptr{};
+				buffers[i]._size = 0;
+				i++;
+			}
+			pool->deallocate_bulk(std::span{ptrs, k}, size, 1, 1);
+		}
+	}
+
 private:
+	// Number of pointers that the bulk functions process per pool call.
+	static constexpr size_t _bulk_chunk = 64;
+
 	dma_ptr _ptr;
 	size_t _size;
 };
@@ -387,7 +656,7 @@ struct dma_object {
 		return sizeof(T);
 	}
 
-	T *data() {
+	T *data() const {
 		return _ptr.get_raw_ptr<T>();
 	}
 
@@ -469,7 +738,7 @@ struct dma_array {
 		return _size;
 	}
 
-	T *data() {
+	T *data() const {
 		return _ptr.get_raw_ptr<T>();
 	}
 
@@ -499,6 +768,243 @@ private:
 	size_t _size;
 };
 
+// ----------------------------------------------------------------------------
+// Storage classes for statically known pools.
+// ----------------------------------------------------------------------------
+
+// Variants of dma_buffer, dma_object and dma_array that always allocate from a pool
+// of type Pool. Allocation and deallocation call Pool directly (instead of going through
+// the region of the dma_ptr) and the raw pointer is cached on allocation.
+// The pool must be non-null and its regions must have a virtual address.
+
+template<dma_pool_type Pool>
+struct static_dma_buffer {
+	friend void swap(static_dma_buffer &a, static_dma_buffer &b) {
+		using std::swap;
+		swap(a._pool, b._pool);
+		swap(a._ptr, b._ptr);
+		swap(a._data, b._data);
+		swap(a._size, b._size);
+	}
+
+	static_dma_buffer() = default;
+
+	static_dma_buffer(static_dma_buffer &&other)
+	: static_dma_buffer() {
+		swap(*this, other);
+	}
+
+	explicit static_dma_buffer(Pool *pool, size_t size)
+	: _pool{pool}, _ptr{pool->allocate(size, 1, 1)},
+			_data{_ptr.get_raw_ptr()}, _size{size} { }
+
+	~static_dma_buffer() {
+		if (!_data)
+			return;
+		_pool->deallocate(_ptr, _size, 1, 1);
+	}
+
+	static_dma_buffer &operator= (static_dma_buffer other) {
+		swap(*this, other);
+		return *this;
+	}
+
+	operator dma_buffer_view () {
+		return dma_buffer_view{_ptr, _size};
+	}
+
+	Pool *pool() const {
+		return _pool;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	void *data() const {
+		return _data;
+	}
+
+	std::byte *byte_data() {
+		return static_cast<std::byte *>(_data);
+	}
+
+	dma_buffer_view subview(size_t offset, size_t chunk) {
+		return dma_buffer_view{_ptr.offset_by(offset), chunk};
+	}
+
+	dma_buffer_view subview(size_t offset) {
+		return dma_buffer_view{_ptr.offset_by(offset), _size - offset};
+	}
+
+	dma_ptr get_dma_ptr() const {
+		return _ptr;
+	}
+
+private:
+	Pool *_pool{nullptr};
+	dma_ptr _ptr;
+	void *_data{nullptr};
+	size_t _size{0};
+};
+
+template<typename T, dma_pool_type Pool>
+struct static_dma_object {
+	friend void swap(static_dma_object &a, static_dma_object &b) {
+		using std::swap;
+		swap(a._pool, b._pool);
+		swap(a._ptr, b._ptr);
+		swap(a._data, b._data);
+	}
+
+	static_dma_object() = default;
+
+	static_dma_object(static_dma_object &&other)
+	: static_dma_object() {
+		swap(*this, other);
+	}
+
+	template<typename... Args>
+	explicit static_dma_object(Pool *pool, Args &&... args)
+	: _pool{pool}, _ptr{pool->allocate(sizeof(T), 1, alignof(T))},
+			_data{_ptr.template get_raw_ptr<T>()} {
+		new (_data) T{std::forward<Args>(args)...};
+	}
+
+	~static_dma_object() {
+		if (!_data)
+			return;
+		_data->~T();
+		_pool->deallocate(_ptr, sizeof(T), 1, alignof(T));
+	}
+
+	static_dma_object &operator= (static_dma_object other) {
+		swap(*this, other);
+		return *this;
+	}
+
+	operator dma_object_view<T> () {
+		return dma_object_view<T>{_ptr};
+	}
+
+	Pool *pool() const {
+		return _pool;
+	}
+
+	constexpr size_t size() const {
+		return sizeof(T);
+	}
+
+	T *data() const {
+		return _data;
+	}
+
+	std::byte *byte_data() {
+		return reinterpret_cast<std::byte *>(_data);
+	}
+
+	T &operator* () {
+		return *_data;
+	}
+
+	T *operator-> () {
+		return _data;
+	}
+
+	dma_buffer_view view_buffer() {
+		return dma_buffer_view{_ptr, sizeof(T)};
+	}
+
+	dma_ptr get_dma_ptr() const {
+		return _ptr;
+	}
+
+private:
+	Pool *_pool{nullptr};
+	dma_ptr _ptr;
+	T *_data{nullptr};
+};
+
+template<typename T, dma_pool_type Pool>
+struct static_dma_array {
+	friend void swap(static_dma_array &a, static_dma_array &b) {
+		using std::swap;
+		swap(a._pool, b._pool);
+		swap(a._ptr, b._ptr);
+		swap(a._data, b._data);
+		swap(a._size, b._size);
+	}
+
+	static_dma_array() = default;
+
+	static_dma_array(static_dma_array &&other)
+	: static_dma_array() {
+		swap(*this, other);
+	}
+
+	explicit static_dma_array(Pool *pool, size_t size)
+	: _pool{pool}, _ptr{pool->allocate(sizeof(T), size, alignof(T))},
+			_data{_ptr.template get_raw_ptr<T>()}, _size{size} {
+		new (_data) T[_size];
+	}
+
+	~static_dma_array() {
+		if (!_data)
+			return;
+		for(size_t i = 0; i < _size; ++i)
+			_data[i].~T();
+		_pool->deallocate(_ptr, sizeof(T), _size, alignof(T));
+	}
+
+	static_dma_array &operator= (static_dma_array other) {
+		swap(*this, other);
+		return *this;
+	}
+
+	operator dma_array_view<T> () {
+		return dma_array_view<T>{_ptr, _size};
+	}
+
+	Pool *pool() const {
+		return _pool;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	T *data() const {
+		return _data;
+	}
+
+	std::byte *byte_data() {
+		return reinterpret_cast<std::byte *>(_data);
+	}
+
+	T &operator[] (size_t n) {
+		return _data[n];
+	}
+
+	arch::dma_object_view<T> object_view(size_t n) {
+		assert(n < _size);
+		return arch::dma_object_view<T>{_ptr.offset_by(n * sizeof(T))};
+	}
+
+	dma_buffer_view view_buffer() {
+		return dma_buffer_view{_ptr, sizeof(T) * _size};
+	}
+
+	dma_ptr get_dma_ptr() const {
+		return _ptr;
+	}
+
+private:
+	Pool *_pool{nullptr};
+	dma_ptr _ptr;
+	T *_data{nullptr};
+	size_t _size{0};
+};
+
 } // namespace arch
 
 #endif // LIBARCH_DMA_HPP
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <assert.h>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <arch/dma_structs.hpp>
+#include <arch/spinlock.hpp>
+
+namespace arch {
+
+// dma_pool that caches small blocks of a backing dma_pool in per-CPU magazines.
+//
+// Allocations of up to max_cached_size bytes are rounded up to a power of two size
+// class (that also covers the alignment). Each of the Slots slots keeps a magazine of
+// up to Capacity free blocks per size class. Allocating and freeing only takes the
+// (uncontended) lock of one slot in the common case; empty magazines are refilled
+// with (and full magazines return) Capacity / 2 blocks using a single bulk operation
+// of the backing pool. The backing pool is never called while a slot lock is held.
+//
+// If current_cpu is non-null, it is used to select the slot; otherwise, the slot is
+// derived from the current stack pointer (such that different threads tend to use
+// different slots). If the selected slot is busy, the next ones are tried.
+//
+// Pointers returned by this pool refer to alias regions whose pool() is this pool
+// such that dma_buffer and friends return their memory to the magazines.
+// The backing pool may use at most MaxRegions distinct regions; allocations from
+// further regions fail.
+template<size_t Slots = 16, size_t Capacity = 32, size_t MaxRegions = 16>
+struct magazine_dma_pool final : dma_pool {
+	static_assert(Slots > 0);
+	static_assert(Capacity >= 2);
+
+	static constexpr size_t min_cached_size = 16;
+	static constexpr size_t max_cached_size = 2048;
+
+private:
+	static constexpr unsigned int _min_shift = 4;
+	static constexpr unsigned int _max_shift = 11;
+	static constexpr unsigned int _num_classes = _max_shift - _min_shift + 1;
+	static constexpr unsigned int _uncached = _num_classes;
+
+	static_assert(min_cached_size == size_t(1) << _min_shift);
+	static_assert(max_cached_size == size_t(1) << _max_shift);
+
+	// Region that aliases a region of the backing pool.
+	struct _alias : dma_region {
+		_alias(magazine_dma_pool *pool, dma_region *backing)
+		: dma_region{pool}, backing{backing} {
+			inherit_mapping(*backing);
+		}
+
+		dma_region *backing;
+	};
+
+	struct _magazine {
+		size_t count{0};
+		dma_ptr entries[Capacity];
+	};
+
+	struct alignas(64) _slot {
+		spinlock lock;
+		_magazine magazines[_num_classes];
+	};
+
+public:
+	explicit magazine_dma_pool(dma_pool *backing, size_t (*current_cpu)() = nullptr)
+	: _backing{backing}, _current_cpu{current_cpu} {
+		assert(backing);
+	}
+
+	magazine_dma_pool(const magazine_dma_pool &) = delete;
+
+	magazine_dma_pool &operator= (const magazine_dma_pool &) = delete;
+
+	~magazine_dma_pool() {
+		flush();
+		auto n = __atomic_load_n(&_num_aliases, __ATOMIC_ACQUIRE);
+		for (size_t i = 0; i < n; i++)
+			_alias_at(i)->~_alias();
+	}
+
+	dma_pool *backing() const {
+		return _backing;
+	}
+
+	// Returns all cached blocks to the backing pool.
+	void flush() {
+		dma_ptr batch[Capacity];
+		for (auto &slot : _slots) {
+			for (unsigned int cls = 0; cls < _num_classes; cls++) {
+				auto &mag = slot.magazines[cls];
+				slot.lock.lock();
+				auto n = mag.count;
+				_take(mag, batch, n);
+				slot.lock.unlock();
+				_free_blocks(cls, std::span{batch, n});
+			}
+		}
+	}
+
+	dma_ptr allocate(size_t size, size_t count, size_t align) override {
+		auto cls = _class_for(size, count, align);
+		if (cls == _uncached)
+			return _wrap(_backing->allocate(size, count, align), size, count, align);
+
+		auto cs = _class_size(cls);
+		auto slot = _lock_slot();
+		if (!slot) {
+			// All slots are busy.
+			return _wrap(_backing->allocate(cs, 1, cs), cs, 1, cs);
+		}
+
+		auto &mag = slot->magazines[cls];
+		if (mag.count) {
+			auto ptr = mag.entries[--mag.count];
+			slot->lock.unlock();
+			return _wrap(ptr, cs, 1, cs);
+		}
+		slot->lock.unlock();
+
+		// Refill the magazine. The backing pool is not called with the slot lock held
+		// (such that the slot's lock is never held for longer than a few instructions).
+		dma_ptr batch[Capacity / 2];
+		auto n = _backing->allocate_bulk(batch, cs, 1, cs);
+		if (!n)
+			return {};
+		auto rest = std::span<const dma_ptr>{batch + 1, n - 1};
+		_free_blocks(cls, rest.last(_stash(*slot, cls, rest)));
+		return _wrap(batch[0], cs, 1, cs);
+	}
+
+	void deallocate(dma_ptr ptr, size_t size, size_t count, size_t align) override {
+		if (!ptr)
+			return;
+		auto backing_ptr = _unwrap(ptr);
+		auto cls = _class_for(size, count, align);
+		if (cls == _uncached) {
+			_backing->deallocate(backing_ptr, size, count, align);
+			return;
+		}
+
+		_stash_or_free(cls, std::span{&backing_ptr, 1});
+	}
+
+	size_t allocate_bulk(std::span<dma_ptr> ptrs, size_t size, size_t count, size_t align) override {
+		auto cls = _class_for(size, count, align);
+		if (cls == _uncached)
+			return _wrap_bulk(ptrs, _backing->allocate_bulk(ptrs, size, count, align), size, count, align);
+
+		auto cs = _class_size(cls);
+		size_t n = 0;
+		if (auto slot = _lock_slot()) {
+			auto &mag = slot->magazines[cls];
+			n = mag.count < ptrs.size() ? mag.count : ptrs.size();
+			_take(mag, ptrs.data(), n);
+			slot->lock.unlock();
+		}
+
+		// The remaining blocks are allocated from the backing pool in a single call.
+		if (n < ptrs.size())
+			n += _backing->allocate_bulk(ptrs.subspan(n), cs, 1, cs);
+		return _wrap_bulk(ptrs, n, cs, 1, cs);
+	}
+
+	void deallocate_bulk(std::span<const dma_ptr> ptrs, size_t size, size_t count, size_t align) override {
+		auto cls = _class_for(size, count, align);
+
+		// Translate the pointers in chunks.
+		dma_ptr chunk[Capacity];
+		size_t k = 0;
+		for (auto ptr : ptrs) {
+			if (!ptr)
+				continue;
+			chunk[k++] = _unwrap(ptr);
+			if (k == Capacity) {
+				_release(cls, std::span{chunk, k}, size, count, align);
+				k = 0;
+			}
+		}
+		if (k)
+			_release(cls, std::span{chunk, k}, size, count, align);
+	}
+
+private:
+	// Returns the size class of an allocation or _uncached.
+	static unsigned int _class_for(size_t size, size_t count, size_t align) {
+		size_t bytes;
+		if (__builtin_mul_overflow(size, count, &bytes))
+			return _uncached;
+		if (bytes < align)
+			bytes = align;
+		if (bytes <= min_cached_size)
+			return 0;
+		if (bytes > max_cached_size)
+			return _uncached;
+		return sizeof(size_t) * 8 - __builtin_clzl(bytes - 1) - _min_shift;
+	}
+
+	// Blocks of a size class are allocated from the backing pool with this size and alignment
+	// such that they can serve all allocations of the class.
+	static size_t _class_size(unsigned int cls) {
+		return size_t(1) << (cls + _min_shift);
+	}
+
+	_slot *_lock_slot() {
+		size_t start;
+		if (_current_cpu) {
+			start = _current_cpu();
+		} else {
+			// Threads do not share stacks; hash the stack address to spread them over the slots.
+			auto sp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+			start = static_cast<size_t>((sp >> 14) * 0x9E3779B97F4A7C15ull >> 32);
+		}
+		for (size_t i = 0; i < Slots; i++) {
+			auto &slot = _slots[(start + i) % Slots];
+			if (slot.lock.try_lock())
+				return &slot;
+		}
+		return nullptr;
+	}
+
+	// Moves the n most recently cached blocks of a magazine to out.
+	// Must be called with the slot lock held.
+	static void _take(_magazine &mag, dma_ptr *out, size_t n) {
+		mag.count -= n;
+		for (size_t i = 0; i < n; i++)
+			out[i] = mag.entries[mag.count + i];
+	}
+
+	// Puts blocks of the backing pool into the magazine of a slot (that is not locked yet).
+	// Returns the number of blocks at the end of blocks that did not fit.
+	static size_t _stash(_slot &slot, unsigned int cls, std::span<const dma_ptr> blocks) {
+		auto &mag = slot.magazines[cls];
+		size_t i = 0;
+		slot.lock.lock();
+		while (i < blocks.size() && mag.count < Capacity)
+			mag.entries[mag.count++] = blocks[i++];
+		slot.lock.unlock();
+		return blocks.size() - i;
+	}
+
+	// Caches blocks of the backing pool (that belong to size class cls) in the magazines.
+	// If the magazine is full, half of it is returned to the backing pool.
+	void _stash_or_free(unsigned int cls, std::span<const dma_ptr> blocks) {
+		auto slot = _lock_slot();
+		if (!slot) {
+			// All slots are busy.
+			_free_blocks(cls, blocks);
+			return;
+		}
+
+		auto &mag = slot->magazines[cls];
+		dma_ptr batch[Capacity / 2];
+		size_t n = 0;
+		if (mag.count + blocks.size() > Capacity && mag.count >= Capacity / 2) {
+			n = Capacity / 2;
+			_take(mag, batch, n);
+		}
+		size_t i = 0;
+		while (i < blocks.size() && mag.count < Capacity)
+			mag.entries[mag.count++] = blocks[i++];
+		slot->lock.unlock();
+
+		// Call the backing pool without holding the slot lock.
+		_free_blocks(cls, std::span{batch, n});
+		_free_blocks(cls, blocks.subspan(i));
+	}
+
+	// Frees blocks of the backing pool: blocks of size classes are cached,
+	// other blocks are returned to the backing pool.
+	void _release(unsigned int cls, std::span<const dma_ptr> blocks,
+			size_t size, size_t count, size_t align) {
+		if (cls == _uncached) {
+			_backing->deallocate_bulk(blocks, size, count, align);
+		} else {
+			_stash_or_free(cls, blocks);
+		}
+	}
+
+	void _free_blocks(unsigned int cls, std::span<const dma_ptr> blocks) {
+		if (blocks.empty())
+			return;
+		auto cs = _class_size(cls);
+		_backing->deallocate_bulk(blocks, cs, 1, cs);
+	}
+
+	_alias *_alias_at(size_t i) {
+		return std::launder(reinterpret_cast<_alias *>(_alias_storage[i]));
+	}
+
+	// Returns the alias region of a region of the backing pool.
+	// Returns nullptr if the backing pool uses more than MaxRegions regions.
+	_alias *_alias_for(dma_region *region) {
+		auto n = __atomic_load_n(&_num_aliases, __ATOMIC_ACQUIRE);
+		for (size_t i = 0; i < n; i++) {
+			if (_alias_at(i)->backing == region)
+				return _alias_at(i);
+		}
+
+		// The region is new; slow path.
+		_alias_lock.lock();
+		n = __atomic_load_n(&_num_aliases, __ATOMIC_RELAXED);
+		for (size_t i = 0; i < n; i++) {
+			if (_alias_at(i)->backing == region) {
+				_alias_lock.unlock();
+				return _alias_at(i);
+			}
+		}
+		if (n == MaxRegions) {
+			_alias_lock.unlock();
+			return nullptr;
+		}
+		auto alias = new (_alias_storage[n]) _alias{this, region};
+		__atomic_store_n(&_num_aliases, n + 1, __ATOMIC_RELEASE);
+		_alias_lock.unlock();
+		return alias;
+	}
+
+	// Translates a pointer of the backing pool (that was allocated with the given size,
+	// count and align) to a pointer into an alias region.
+	// If the backing pool has more than MaxRegions regions, pointers into regions that
+	// do not fit into the alias table are returned to the backing pool and the allocation
+	// fails (i.e., a null dma_ptr is returned).
+	dma_ptr _wrap(dma_ptr ptr, size_t size, size_t count, size_t align) {
+		if (!ptr)
+			return {};
+		auto alias = _alias_for(ptr.region());
+		if (!alias) {
+			_backing->deallocate(ptr, size, count, align);
+			return {};
+		}
+		return dma_ptr{alias, ptr.offset()};
+	}
+
+	// Same as _wrap() for ptrs[0, n). Returns the number of pointers that could be wrapped;
+	// these are moved to the start of ptrs.
+	size_t _wrap_bulk(std::span<dma_ptr> ptrs, size_t n, size_t size, size_t count, size_t align) {
+		size_t k = 0;
+		for (size_t i = 0; i < n; i++) {
+			auto ptr = _wrap(ptrs[i], size, count, align);
+			if (ptr)
+				ptrs[k++] = ptr;
+		}
+		return k;
+	}
+
+	static dma_ptr _unwrap(dma_ptr ptr) {
+		auto alias = static_cast<_alias *>(ptr.region());
+		return dma_ptr{alias->backing, ptr.offset()};
+	}
+
+	dma_pool *_backing;
+	size_t (*_current_cpu)();
+
+	_slot _slots[Slots];
+
+	spinlock _alias_lock;
+	size_t _num_aliases{0};
+	alignas(_alias) unsigned char _alias_storage[MaxRegions][sizeof(_alias)];
+};
+
+} // namespace arch
@@ -12,10 +12,80 @@
 #	error Unsupported architecture
 #endif
 
+#include <optional>
+
+#include <arch/register.hpp>
+
 namespace arch {
 
 namespace _details {
 
+// Stores [src,src+size) to dst using relaxed accesses. Uses the widest naturally
+// aligned accesses that are supported by the architecture.
+inline void store_words_relaxed(uintptr_t dst, const char *src, size_t size) {
+	size_t done = _detail::store_burst_wide(reinterpret_cast<void *>(dst), src, size);
+	while (done < size) {
+		auto d = dst + done;
+		auto n = size - done;
+#if UINTPTR_MAX >= UINT64_MAX
+		if (!(d & 7) && n >= 8) {
+			uint64_t v;
+			__builtin_memcpy(&v, src + done, 8);
+			_detail::mem_ops<uint64_t>::store_relaxed(reinterpret_cast<uint64_t *>(d), v);
+			done += 8;
+			continue;
+		}
+#endif
+		if (!(d & 3) && n >= 4) {
+			uint32_t v;
+			__builtin_memcpy(&v, src + done, 4);
+			_detail::mem_ops<uint32_t>::store_relaxed(reinterpret_cast<uint32_t *>(d), v);
+			done += 4;
+		} else if (!(d & 1) && n >= 2) {
+			uint16_t v;
+			__builtin_memcpy(&v, src + done, 2);
+			_detail::mem_ops<uint16_t>::store_relaxed(reinterpret_cast<uint16_t *>(d), v);
+			done += 2;
+		} else {
+			uint8_t v;
+			__builtin_memcpy(&v, src + done, 1);
+			_detail::mem_ops<uint8_t>::store_relaxed(reinterpret_cast<uint8_t *>(d), v);
+			done += 1;
+		}
+	}
+}
+
+// Loads [src,src+size) into dst using relaxed accesses. Uses the widest naturally
+// aligned accesses that are supported by the architecture.
+inline void load_words_relaxed(char *dst, uintptr_t src, size_t size) {
+	size_t done = _detail::load_burst_wide(dst, reinterpret_cast<const void *>(src), size);
+	while (done < size) {
+		auto s = src + done;
+		auto n = size - done;
+#if UINTPTR_MAX >= UINT64_MAX
+		if (!(s & 7) && n >= 8) {
+			auto v = _detail::mem_ops<uint64_t>::load_relaxed(reinterpret_cast<const uint64_t *>(s));
+			__builtin_memcpy(dst + done, &v, 8);
+			done += 8;
+			continue;
+		}
+#endif
+		if (!(s & 3) && n >= 4) {
+			auto v = _detail::mem_ops<uint32_t>::load_relaxed(reinterpret_cast<const uint32_t *>(s));
+			__builtin_memcpy(dst + done, &v, 4);
+			done += 4;
+		} else if (!(s & 1) && n >= 2) {
+			auto v = _detail::mem_ops<uint16_t>::load_relaxed(reinterpret_cast<const uint16_t *>(s));
+			__builtin_memcpy(dst + done, &v, 2);
+			done += 2;
+		} else {
+			auto v = _detail::mem_ops<uint8_t>::load_relaxed(reinterpret_cast<const uint8_t *>(s));
+			__builtin_memcpy(dst + done, &v, 1);
+			done += 1;
+		}
+	}
+}
+
 template<template<typename> typename Ops>
 struct base_mem_space {
 	constexpr base_mem_space()
@@ -59,7 +129,255 @@ struct base_mem_space {
 		return static_cast<typename RT::rep_type>(b);
 	}
 
+	// One-sided variants of load() and store(). load_acquire() only orders later
+	// accesses after the load and store_release() only orders earlier accesses before the
+	// store (see docs/src/memory-order.md). Backends that do not have dedicated
+	// instructions combine a relaxed access with the corresponding barrier of load()
+	// or store().
+
+	template<typename RT>
+	void store_release(RT r, typename RT::rep_type value) const {
+		auto p = reinterpret_cast<typename RT::bits_type *>(_base + r.offset());
+		auto v = static_cast<typename RT::bits_type>(value);
+		using ops = Ops<typename RT::bits_type>;
+		if constexpr (requires { ops::store_release(p, v); }) {
+			ops::store_release(p, v);
+		} else {
+			_barriers::before_store();
+			ops::store_relaxed(p, v);
+		}
+	}
+
+	template<typename RT>
+	typename RT::rep_type load_acquire(RT r) const {
+		auto p = reinterpret_cast<const typename RT::bits_type *>(_base + r.offset());
+		using ops = Ops<typename RT::bits_type>;
+		if constexpr (requires { ops::load_acquire(p); }) {
+			return static_cast<typename RT::rep_type>(ops::load_acquire(p));
+		} else {
+			auto b = ops::load_relaxed(p);
+			_barriers::after_load();
+			return static_cast<typename RT::rep_type>(b);
+		}
+	}
+
+	// Accesses to both halves of a split_register. The ordering guarantees of
+	// load() and store() apply to the pair of accesses as a whole; there is no barrier
+	// between the two halves (which are ordered by the I/O memory ordering of the mapping).
+
+	template<typename T, typename H, split_order Order, typename P>
+	void store(split_register<T, H, Order, P> r,
+			typename split_register<T, H, Order, P>::rep_type value) const {
+		_barriers::before_store();
+		store_relaxed(r, value);
+		_barriers::after_store();
+	}
+
+	template<typename T, typename H, split_order Order, typename P>
+	T load(split_register<T, H, Order, P> r) const {
+		_barriers::before_load();
+		auto v = load_relaxed(r);
+		_barriers::after_load();
+		return v;
+	}
+
+	template<typename T, typename H, split_order Order, typename P>
+	void store_relaxed(split_register<T, H, Order, P> r,
+			typename split_register<T, H, Order, P>::rep_type value) const {
+		auto p = reinterpret_cast<H *>(_base + r.offset());
+		auto lo = static_cast<H>(value);
+		auto hi = static_cast<H>(value >> (8 * sizeof(H)));
+		if constexpr (Order == split_order::lo_hi) {
+			Ops<H>::store_relaxed(p, lo);
+			Ops<H>::store_relaxed(p + 1, hi);
+		} else {
+			Ops<H>::store_relaxed(p + 1, hi);
+			Ops<H>::store_relaxed(p, lo);
+		}
+	}
+
+	template<typename T, typename H, split_order Order, typename P>
+	T load_relaxed(split_register<T, H, Order, P> r) const {
+		auto p = reinterpret_cast<const H *>(_base + r.offset());
+		H lo, hi;
+		if constexpr (Order == split_order::lo_hi) {
+			lo = Ops<H>::load_relaxed(p);
+			hi = Ops<H>::load_relaxed(p + 1);
+		} else {
+			hi = Ops<H>::load_relaxed(p + 1);
+			lo = Ops<H>::load_relaxed(p);
+		}
+		return (static_cast<T>(hi) << (8 * sizeof(H))) | lo;
+	}
+
+	// Variants for registers that are known at compile time, e.g., space.load<regs::status>().
+	// The register needs to be a constexpr object with static storage duration
+	// (see register_block); since its offset is a constant expression, it is folded
+	// into the access.
+
+	template<const auto &R>
+	void store(typename register_type<R>::rep_type value) const {
+		store(R, value);
+	}
+
+	template<const auto &R>
+	typename register_type<R>::rep_type load() const {
+		return load(R);
+	}
+
+	template<const auto &R>
+	void store_relaxed(typename register_type<R>::rep_type value) const {
+		store_relaxed(R, value);
+	}
+
+	template<const auto &R>
+	typename register_type<R>::rep_type load_relaxed() const {
+		return load_relaxed(R);
+	}
+
+	// Scope for a sequence of stores that only need to be ordered against preceding main
+	// memory accesses as a whole, e.g., acknowledging and re-arming an interrupt:
+	//   {
+	//     io_mem_space::store_scope stores{space};
+	//     stores.store(regs::irq_ack, ...);
+	//     stores.store(regs::tail, ...);
+	//   }
+	// The barrier of store() is only issued once when the scope is constructed;
+	// the stores themselves are relaxed.
+	struct store_scope {
+		explicit store_scope(const base_mem_space &space)
+		: _space{space} {
+			_barriers::before_store();
+		}
+
+		store_scope(const store_scope &) = delete;
+		store_scope &operator=(const store_scope &) = delete;
+
+		~store_scope() {
+			_barriers::after_store();
+		}
+
+		template<typename RT>
+		void store(RT r, typename RT::rep_type value) const {
+			_space.store_relaxed(r, value);
+		}
+
+		template<const auto &R>
+		void store(typename register_type<R>::rep_type value) const {
+			_space.template store_relaxed<R>(value);
+		}
+
+	private:
+		base_mem_space _space;
+	};
+
+	// Scope for a sequence of loads whose results are consumed together, e.g., reading
+	// a set of status registers before inspecting DMA buffers.
+	// The barrier of load() is only issued once when the scope is destructed;
+	// the loads themselves are relaxed.
+	struct load_scope {
+		explicit load_scope(const base_mem_space &space)
+		: _space{space} {
+			_barriers::before_load();
+		}
+
+		load_scope(const load_scope &) = delete;
+		load_scope &operator=(const load_scope &) = delete;
+
+		~load_scope() {
+			_barriers::after_load();
+		}
+
+		template<typename RT>
+		typename RT::rep_type load(RT r) const {
+			return _space.load_relaxed(r);
+		}
+
+		template<const auto &R>
+		typename register_type<R>::rep_type load() const {
+			return _space.template load_relaxed<R>();
+		}
+
+	private:
+		base_mem_space _space;
+	};
+
+	// Loads r until pred(value) returns true and returns that value.
+	// The register is read using relaxed accesses with an exponential backoff
+	// (using the CPU's spin-wait hint) in between. The ordering guarantees of load()
+	// only apply to the final access, i.e., the barriers are only issued once.
+	template<typename RT, typename Pred>
+	typename RT::rep_type poll_until(RT r, Pred pred) const {
+		return *poll_until(r, pred, [] { return false; });
+	}
+
+	// Same as above but gives up once timeout() returns true (e.g., because a deadline has
+	// passed). Returns std::nullopt in this case.
+	template<typename RT, typename Pred, typename Timeout>
+	std::optional<typename RT::rep_type> poll_until(RT r, Pred pred, Timeout timeout) const {
+		unsigned int backoff = 1;
+		_barriers::before_load();
+		while (true) {
+			auto v = load_relaxed(r);
+			if (pred(v)) {
+				_barriers::after_load();
+				return v;
+			}
+			if (timeout())
+				return std::nullopt;
+			for (unsigned int i = 0; i < backoff; i++)
+				_detail::cpu_relax();
+			if (backoff < _max_poll_backoff)
+				backoff *= 2;
+		}
+	}
+
+	// Variants that wait until the fields in cond take the given values, e.g.:
+	//   space.poll_until(regs::status, status::ready(true));
+	template<typename B, typename P>
+	bit_value<B> poll_until(bit_register<B, P> r, masked_bit_value<B> cond) const {
+		return poll_until(r, [cond] (bit_value<B> v) {
+			return (static_cast<B>(v) & cond.mask()) == cond.bits();
+		});
+	}
+
+	template<typename B, typename P, typename Timeout>
+	std::optional<bit_value<B>> poll_until(bit_register<B, P> r, masked_bit_value<B> cond,
+			Timeout timeout) const {
+		return poll_until(r, [cond] (bit_value<B> v) {
+			return (static_cast<B>(v) & cond.mask()) == cond.bits();
+		}, timeout);
+	}
+
+	// Copies [offset,offset+size) to dst (similar to Linux' memcpy_fromio()).
+	// Uses relaxed accesses of the widest naturally aligned size. The range as a whole has
+	// the same ordering guarantees as load() but the individual accesses are not
+	// ordered against each other.
+	void load_range(ptrdiff_t offset, void *dst, size_t size) const {
+		_barriers::before_load();
+		load_words_relaxed(static_cast<char *>(dst), _base + offset, size);
+		_barriers::after_load();
+	}
+
+	// Copies src to [offset,offset+size) (similar to Linux' memcpy_toio()), e.g., to push
+	// a descriptor together with a doorbell. Uses the widest stores that are available
+	// (such as movdir64b on x86 or stp on Aarch64) such that suitably aligned ranges
+	// reach the device in as few transactions as possible. The range as a whole has
+	// the same ordering guarantees as store() but the individual accesses are not
+	// ordered against each other.
+	void store_range(ptrdiff_t offset, const void *src, size_t size) const {
+		_barriers::before_store();
+		store_words_relaxed(_base + offset, static_cast<const char *>(src), size);
+		_barriers::after_store();
+	}
+
 private:
+	// The barriers do not depend on the width of the access.
+	using _barriers = Ops<uint8_t>;
+
+	// Maximal number of spin-wait hints between two accesses in poll_until().
+	static constexpr unsigned int _max_poll_backoff = 64;
+
 	uintptr_t _base;
 };
 
@@ -2,7 +2,9 @@
 #ifndef LIBARCH_REGISTER_HPP
 #define LIBARCH_REGISTER_HPP
 
+#include <initializer_list>
 #include <stddef.h>
+#include <type_traits>
 
 #include <arch/bits.hpp>
 
@@ -16,7 +18,7 @@ struct basic_register {
 	explicit constexpr basic_register(P offset)
 	: _offset(offset) { }
 
-	P offset() const {
+	constexpr P offset() const {
 		return _offset;
 	}
 
@@ -30,6 +32,129 @@ using scalar_register = basic_register<T, T, P>;
 template<typename B, typename P = ptrdiff_t>
 using bit_register = basic_register<bit_value<B>, B, P>;
 
+// Order in which the halves of a split_register are accessed.
+enum class split_order {
+	lo_hi,
+	hi_lo
+};
+
+// A register of type T that the device only supports accessing as two halves of type H,
+// e.g., a 64-bit queue pointer on a 32-bit bus. The lower half is at offset and the
+// upper half is at offset + sizeof(H). Devices usually latch the full value on the
+// access to one of the halves; Order selects which half is accessed last.
+template<typename T, typename H, split_order Order = split_order::lo_hi, typename P = ptrdiff_t>
+struct split_register {
+	static_assert(sizeof(T) == 2 * sizeof(H), "halves must be half as wide as the register");
+
+	using rep_type = T;
+	using half_type = H;
+
+	static constexpr split_order order = Order;
+
+	explicit constexpr split_register(P offset)
+	: _offset(offset) { }
+
+	constexpr P offset() const {
+		return _offset;
+	}
+
+private:
+	P _offset;
+};
+
+namespace _details {
+
+template<const auto &R>
+using register_type = std::remove_cvref_t<decltype(R)>;
+
+// Number of bytes that a register of type RT covers
+// and alignment that is required by its accesses.
+template<typename RT>
+inline constexpr size_t register_size = sizeof(typename RT::bits_type);
+
+template<typename T, typename H, split_order Order, typename P>
+inline constexpr size_t register_size<split_register<T, H, Order, P>> = sizeof(T);
+
+template<typename RT>
+inline constexpr size_t register_alignment = sizeof(typename RT::bits_type);
+
+template<typename T, typename H, split_order Order, typename P>
+inline constexpr size_t register_alignment<split_register<T, H, Order, P>> = sizeof(H);
+
+template<const auto &R>
+inline constexpr ptrdiff_t register_end = R.offset()
+		+ static_cast<ptrdiff_t>(register_size<register_type<R>>);
+
+struct register_extent {
+	ptrdiff_t begin;
+	ptrdiff_t end;
+};
+
+constexpr bool extents_overlap(const register_extent *extents, size_t n) {
+	for (size_t i = 0; i < n; i++)
+		for (size_t j = i + 1; j < n; j++)
+			if (extents[i].begin < extents[j].end && extents[j].begin < extents[i].end)
+				return true;
+	return false;
+}
+
+} // namespace _details
+
+// Compile-time description of the registers of a device (or of a block within a device).
+// Registers are passed by reference, hence they need to be constexpr objects with static
+// storage duration. For example:
+//   namespace regs {
+//     inline constexpr arch::bit_register<uint32_t> ctrl{0x00};
+//     inline constexpr arch::bit_register<uint32_t> status{0x04};
+//     inline constexpr arch::scalar_register<uint64_t> base{0x08};
+//     using block = arch::register_block<ctrl, status, base>;
+//   }
+// Misaligned or overlapping registers are rejected at compile time.
+// The same registers can be accessed as space.load<regs::status>(), which does
+// not need any address arithmetic at run time.
+template<const auto &... Regs>
+struct register_block {
+	static_assert(sizeof...(Regs) > 0, "register_block must not be empty");
+	static_assert(((Regs.offset() >= 0) && ...), "register offsets must not be negative");
+	static_assert(((Regs.offset() % _details::register_alignment<_details::register_type<Regs>> == 0)
+			&& ...), "registers must be naturally aligned");
+
+private:
+	static constexpr _details::register_extent _extents[] = {
+		{Regs.offset(), _details::register_end<Regs>}...
+	};
+
+	static_assert(!_details::extents_overlap(_extents, sizeof...(Regs)),
+			"registers must not overlap");
+
+public:
+	// Number of bytes that are covered by the block.
+	static constexpr ptrdiff_t size = [] {
+		ptrdiff_t end = 0;
+		for (auto e : _extents)
+			if (e.end > end)
+				end = e.end;
+		return end;
+	}();
+
+	// Whether R is part of this block.
+	template<const auto &R>
+	static constexpr bool contains = ((static_cast<const void *>(&R) == &Regs) || ...);
+};
+
+// Returns true if no two of the given fields share a bit, e.g.:
+//   static_assert(arch::disjoint_fields(ctrl::enable, ctrl::mode));
+template<typename B, typename... T>
+constexpr bool disjoint_fields(field<B, T>... fs) {
+	B seen = 0;
+	for (B mask : {B(0), fs.mask()...}) {
+		if (seen & mask)
+			return false;
+		seen |= mask;
+	}
+	return true;
+}
+
 // Space is second because otherwise you can't do scalar_load<uint32_t> etc
 template<typename T, typename Space>
 T scalar_load(Space &s, ptrdiff_t offset) {
@@ -52,6 +177,108 @@ void scalar_store_relaxed(Space &s, ptrdiff_t offset, T val) {
 	return s.store_relaxed(scalar_register<T>(offset), val);
 }
 
+// Collects updates to the fields of a bit_register and applies all of them
+// using a single load() and store(). For example:
+//   register_update u{space, regs::ctrl};
+//   u /= ctrl::enable(true);
+//   u /= ctrl::mode(3);
+//   u.commit();
+template<typename Space, typename B, typename P = ptrdiff_t>
+struct register_update {
+	register_update(Space space, bit_register<B, P> reg)
+	: _space{space}, _reg{reg}, _bits{0}, _mask{0} { }
+
+	// Later updates to the same bits override earlier ones.
+	register_update &operator/= (masked_bit_value<B> v) {
+		_bits = (_bits & ~v.mask()) | v.bits();
+		_mask |= v.mask();
+		return *this;
+	}
+
+	// Bits that are covered by the updates collected so far.
+	B mask() const {
+		return _mask;
+	}
+
+	// Writes the updated value to the register and returns it.
+	// The register is only loaded if the updates do not cover all of its bits.
+	bit_value<B> commit() const {
+		if (_mask == static_cast<B>(~B(0)))
+			return commit_write_only();
+		bit_value<B> v = _space.load(_reg);
+		v /= masked_bit_value<B>(_bits, _mask);
+		_space.store(_reg, v);
+		return v;
+	}
+
+	// Writes the collected bits to the register without loading it first.
+	// All bits that are not covered by the updates are written as zero.
+	bit_value<B> commit_write_only() const {
+		bit_value<B> v{_bits};
+		_space.store(_reg, v);
+		return v;
+	}
+
+private:
+	Space _space;
+	bit_register<B, P> _reg;
+	B _bits;
+	B _mask;
+};
+
+// Keeps a copy of the last value written to a bit_register in normal memory.
+// Intended for write-only registers and for registers that only the driver modifies:
+// updates are computed against the shadow copy such that only the store reaches
+// the device. Registers that the hardware can change need explicit resync() calls.
+template<typename Space, typename B, typename P = ptrdiff_t>
+struct shadowed_register {
+	// Initializes the shadow copy without accessing the device,
+	// e.g., to the reset value of a write-only register.
+	shadowed_register(Space space, bit_register<B, P> reg, bit_value<B> initial)
+	: _space{space}, _reg{reg}, _shadow{static_cast<B>(initial)} { }
+
+	// Initializes the shadow copy by loading the register.
+	shadowed_register(Space space, bit_register<B, P> reg)
+	: _space{space}, _reg{reg}, _shadow{0} {
+		resync();
+	}
+
+	// Returns the shadow copy. Does not access the device.
+	bit_value<B> load() const {
+		return bit_value<B>{_shadow};
+	}
+
+	void store(bit_value<B> v) {
+		_shadow = static_cast<B>(v);
+		_space.store(_reg, v);
+	}
+
+	// Applies v to the shadow copy and writes the result to the register.
+	bit_value<B> update(masked_bit_value<B> v) {
+		bit_value<B> n{_shadow};
+		n /= v;
+		store(n);
+		return n;
+	}
+
+	shadowed_register &operator/= (masked_bit_value<B> v) {
+		update(v);
+		return *this;
+	}
+
+	// Reloads the shadow copy from the device.
+	bit_value<B> resync() {
+		bit_value<B> v = _space.load(_reg);
+		_shadow = static_cast<B>(v);
+		return v;
+	}
+
+private:
+	Space _space;
+	bit_register<B, P> _reg;
+	B _shadow;
+};
+
 } // namespace arch
 
 #endif // LIBARCH_REGISTER_HPP
@@ -1,50 +1,152 @@
 #pragma once
 
+#include <assert.h>
 #include <stdint.h>
 #include <stddef.h>
 
 namespace arch {
 
+// Cache parameters that cannot be discovered by the CPU itself.
+// Platform code is expected to fill this in early, e.g., from the device tree.
+struct cache_geometry {
+	// Size of the blocks affected by Zicbom instructions (riscv,cbom-block-size).
+	size_t cbom_block_size;
+};
+
 namespace detail_ {
 
+// 64 should be a safe guess for current CPUs if the platform does not
+// call set_cache_geometry().
+inline size_t cbom_block_size_ = 64;
+
 inline size_t dcache_line_size() {
-	// TODO: This information has to be obtained from the device tree.
-	// 64 should be a safe guess for current CPUs (might result in some extra
-	// flush/clean instructions at worst).
-	return 64;
+	return __atomic_load_n(&cbom_block_size_, __ATOMIC_RELAXED);
 }
 
-// Clean cache lines.
-[[gnu::target("arch=+zicbom")]] inline void cache_clean(uintptr_t addr, size_t size) {
-	auto dsz = dcache_line_size();
-	for (auto cur = addr & ~(dsz - 1); cur < addr + size; cur += dsz) {
-		asm volatile ("cbo.clean 0(%0)" :: "r"(cur) : "memory");
+// Clean cache blocks of size B (or of the run time block size if B is zero).
+template<size_t B>
+[[gnu::target("arch=+zicbom")]] inline void cbo_clean_lines(uintptr_t addr, size_t size) {
+	size_t dsz = B ? B : dcache_line_size();
+	auto begin = addr & ~(dsz - 1);
+	size_t n = (addr + size - begin + dsz - 1) >> __builtin_ctzl(dsz);
+	for (size_t i = 0; i < n; i++) {
+		asm volatile ("cbo.clean 0(%0)" :: "r"(begin + i * dsz) : "memory");
+	}
+}
+
+// Flush cache blocks of size B (or of the run time block size if B is zero).
+template<size_t B>
+[[gnu::target("arch=+zicbom")]] inline void cbo_flush_lines(uintptr_t addr, size_t size) {
+	size_t dsz = B ? B : dcache_line_size();
+	auto begin = addr & ~(dsz - 1);
+	size_t n = (addr + size - begin + dsz - 1) >> __builtin_ctzl(dsz);
+	for (size_t i = 0; i < n; i++) {
+		asm volatile ("cbo.flush 0(%0)" :: "r"(begin + i * dsz) : "memory");
+	}
+}
+
+// Clean cache lines. Needs to be followed by cache_fence().
+// Common block sizes (or L, if it is non-zero) use a loop with a constant stride.
+template<size_t L = 0>
+inline void cache_clean_lines(uintptr_t addr, size_t size) {
+	if constexpr (L) {
+		cbo_clean_lines<L>(addr, size);
+		return;
+	}
+	switch (dcache_line_size()) {
+	case 32: cbo_clean_lines<32>(addr, size); break;
+	case 64: cbo_clean_lines<64>(addr, size); break;
+	case 128: cbo_clean_lines<128>(addr, size); break;
+	default: cbo_clean_lines<0>(addr, size);
 	}
-	asm volatile ("fence w, iorw" ::: "memory");
 }
 
-// Flush cache lines.
-[[gnu::target("arch=+zicbom")]] inline void cache_flush(uintptr_t addr, size_t size) {
-	auto dsz = dcache_line_size();
-	for (auto cur = addr & ~(dsz - 1); cur < addr + size; cur += dsz) {
-		asm volatile ("cbo.flush 0(%0)" :: "r"(cur) : "memory");
+// Flush cache lines. Needs to be followed by cache_fence().
+// Common block sizes (or L, if it is non-zero) use a loop with a constant stride.
+template<size_t L = 0>
+inline void cache_flush_lines(uintptr_t addr, size_t size) {
+	if constexpr (L) {
+		cbo_flush_lines<L>(addr, size);
+		return;
 	}
+	switch (dcache_line_size()) {
+	case 32: cbo_flush_lines<32>(addr, size); break;
+	case 64: cbo_flush_lines<64>(addr, size); break;
+	case 128: cbo_flush_lines<128>(addr, size); break;
+	default: cbo_flush_lines<0>(addr, size);
+	}
+}
+
+inline void cache_fence() {
 	asm volatile ("fence w, iorw" ::: "memory");
 }
 
+// Maintenance operations used by arch/cache.hpp.
+// lines<L>() walks a range without a trailing barrier (using a line size of L unless L is zero),
+// fence() completes all preceding lines() calls and try_whole() maintains the entire cache
+// if that is cheaper than walking size bytes.
+
+struct writeback_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_clean_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t) {
+		return false;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
+using clean_or_invalidate_op = writeback_op;
+
+// There are no non-temporal stores that are guaranteed to bypass the cache,
+// hence copies are written back line by line by the generic implementation in arch/cache.hpp.
+template<typename WritebackOp>
+struct copy_then_writeback_op;
+
+using copy_writeback_op = copy_then_writeback_op<writeback_op>;
+
+struct invalidate_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_flush_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t) {
+		return false;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
 } // namespace detail_
 
 
-inline void cache_writeback(uintptr_t addr, size_t size) {
-	detail_::cache_clean(addr, size);
+inline void set_cache_geometry(const cache_geometry &geometry) {
+	assert(geometry.cbom_block_size
+			&& !(geometry.cbom_block_size & (geometry.cbom_block_size - 1)));
+	__atomic_store_n(&detail_::cbom_block_size_, geometry.cbom_block_size, __ATOMIC_RELAXED);
 }
 
-inline void cache_clean_or_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_clean(addr, size);
+inline cache_geometry get_cache_geometry() {
+	return {detail_::dcache_line_size()};
 }
 
-inline void cache_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_flush(addr, size);
+// Zicbom does not provide operations that act on the entire cache.
+// The whole cache threshold is only accepted for parity with other architectures
+// and all ranges are maintained line by line.
+inline void set_whole_cache_threshold(size_t) { }
+
+inline size_t whole_cache_threshold() {
+	return SIZE_MAX;
 }
 
+inline void calibrate_whole_cache_threshold() { }
+
 } // namespace arch
@@ -8,24 +8,58 @@
 namespace arch {
 
 namespace _detail {
+	// Barriers that are required around relaxed accesses to implement load() and store().
+	struct mem_barriers {
+		static void before_load() {
+			asm volatile ("" ::: "memory");
+		}
+		static void after_load() {
+			asm volatile ("" ::: "memory");
+		}
+
+		static void before_store() {
+			asm volatile ("" ::: "memory");
+		}
+		static void after_store() {
+			asm volatile ("" ::: "memory");
+		}
+	};
+
+	// Spin-wait hint used while polling device registers.
+	// This is the encoding of pause from Zihintpause; it is a no-op on harts without it.
+	inline void cpu_relax() {
+		asm volatile (".insn i 0x0F, 0, x0, x0, 0x010" ::: "memory");
+	}
+
 	template<typename B>
 	struct mem_ops;
 
+	// The atomic operations are sequentially consistent. They are only available
+	// for 32-bit and 64-bit values since narrower AMOs require Zabha.
+
 	template<>
-	struct mem_ops<uint8_t> {
+	struct mem_ops<uint8_t> : mem_barriers {
 		static void store(uint8_t *p, uint8_t v) {
 			asm volatile ("sb %0, %1" : : "r"(v), "m"(*p) : "memory");
 		}
+		static void store_relaxed(uint8_t *p, uint8_t v) {
+			asm volatile ("sb %0, %1" : : "r"(v), "m"(*p));
+		}
 
 		static uint8_t load(const uint8_t *p) {
 			uint8_t v;
 			asm volatile ("lbu %0, %1" : "=r"(v) : "m"(*p) : "memory");
 			return v;
 		}
+		static uint8_t load_relaxed(const uint8_t *p) {
+			uint8_t v;
+			asm volatile ("lbu %0, %1" : "=r"(v) : "m"(*p));
+			return v;
+		}
 	};
 
 	template<>
-	struct mem_ops<uint16_t> {
+	struct mem_ops<uint16_t> : mem_barriers {
 		static void store(uint16_t *p, uint16_t v) {
 			asm volatile ("sh %0, %1" : : "r"(v), "m"(*p) : "memory");
 		}
@@ -46,7 +80,7 @@ namespace _detail {
 	};
 
 	template<>
-	struct mem_ops<uint32_t> {
+	struct mem_ops<uint32_t> : mem_barriers {
 		static void store(uint32_t *p, uint32_t v) {
 			asm volatile ("sw %0, %1" : : "r"(v), "m"(*p) : "memory");
 		}
@@ -64,10 +98,51 @@ namespace _detail {
 			asm volatile ("lwu %0, %1" : "=r"(v) : "m"(*p));
 			return v;
 		}
+
+		static uint32_t atomic_exchange(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile ("amoswap.w.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint32_t *p, uint32_t &expected, uint32_t desired) {
+			uint32_t old;
+			uint64_t s;
+			asm volatile ("1:\n\t"
+					"lr.w.aqrl %0, %2\n\t"
+					"bne %0, %3, 2f\n\t"
+					"sc.w.rl %1, %4, %2\n\t"
+					"bnez %1, 1b\n\t"
+					"2:"
+					: "=&r"(old), "=&r"(s), "+A"(*p)
+					// lr.w sign-extends the loaded value.
+					: "r"(static_cast<int64_t>(static_cast<int32_t>(expected))), "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
+
+		static uint32_t atomic_fetch_add(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile ("amoadd.w.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static uint32_t atomic_fetch_or(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile ("amoor.w.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static uint32_t atomic_fetch_and(uint32_t *p, uint32_t v) {
+			uint32_t old;
+			asm volatile ("amoand.w.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
 	};
 
 	template<>
-	struct mem_ops<uint64_t> {
+	struct mem_ops<uint64_t> : mem_barriers {
 		static void store(uint64_t *p, uint64_t v) {
 			asm volatile ("sd %0, %1" : : "r"(v), "m"(*p) : "memory");
 		}
@@ -85,38 +160,130 @@ namespace _detail {
 			asm volatile ("ld %0, %1" : "=r"(v) : "m"(*p));
 			return v;
 		}
+		static uint64_t atomic_exchange(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile ("amoswap.d.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static bool atomic_compare_exchange(uint64_t *p, uint64_t &expected, uint64_t desired) {
+			uint64_t old;
+			uint64_t s;
+			asm volatile ("1:\n\t"
+					"lr.d.aqrl %0, %2\n\t"
+					"bne %0, %3, 2f\n\t"
+					"sc.d.rl %1, %4, %2\n\t"
+					"bnez %1, 1b\n\t"
+					"2:"
+					: "=&r"(old), "=&r"(s), "+A"(*p)
+					: "r"(expected), "r"(desired) : "memory");
+			bool success = old == expected;
+			expected = old;
+			return success;
+		}
 
-		// TODO: Implement:
-		static uint64_t atomic_exchange(uint64_t *p, uint64_t v);
+		static uint64_t atomic_fetch_add(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile ("amoadd.d.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static uint64_t atomic_fetch_or(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile ("amoor.d.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
+
+		static uint64_t atomic_fetch_and(uint64_t *p, uint64_t v) {
+			uint64_t old;
+			asm volatile ("amoand.d.aqrl %0, %2, %1" : "=r"(old), "+A"(*p) : "r"(v) : "memory");
+			return old;
+		}
 	};
+
+	// Stores (or loads) a prefix of [src,src+size) to dst using accesses wider than the
+	// general purpose registers. There are no such accesses on this architecture.
+	inline size_t store_burst_wide(void *, const void *, size_t) {
+		return 0;
+	}
+
+	inline size_t load_burst_wide(void *, const void *, size_t) {
+		return 0;
+	}
 }
 
 template<typename B>
 struct io_mem_ops {
-    static B load(const B *p) {
+    static void before_load() {
         asm volatile("fence r, i" ::: "memory");
-        auto v = _detail::mem_ops<B>::load_relaxed(p);
+    }
+    static void after_load() {
         asm volatile("fence i, rw" ::: "memory");
+    }
+
+    static void before_store() {
+        asm volatile("fence rw, o" ::: "memory");
+    }
+    static void after_store() {
+        asm volatile("fence o, w" ::: "memory");
+    }
+
+    static B load(const B *p) {
+        before_load();
+        auto v = _detail::mem_ops<B>::load_relaxed(p);
+        after_load();
         return v;
     }
 
     static void store(B *p, B v) {
-        asm volatile("fence rw, o" ::: "memory");
+        before_store();
+        _detail::mem_ops<B>::store_relaxed(p, v);
+        after_store();
+    }
+
+    static B load_relaxed(const B *p) {
+        return _detail::mem_ops<B>::load_relaxed(p);
+    }
+
+    static void store_relaxed(B *p, B v) {
         _detail::mem_ops<B>::store_relaxed(p, v);
-        asm volatile("fence o, w" ::: "memory");
     }
 };
 
 template<typename B>
 struct main_mem_ops {
+    static void before_load() {
+        asm volatile("" ::: "memory");
+    }
+    static void after_load() {
+        asm volatile("fence r, rw" ::: "memory");
+    }
+
+    static void before_store() {
+        asm volatile("fence rw, w" ::: "memory");
+    }
+    static void after_store() {
+        asm volatile("" ::: "memory");
+    }
+
     static B load(const B *p) {
+        before_load();
         auto v = _detail::mem_ops<B>::load_relaxed(p);
-        asm volatile("fence r, rw" ::: "memory");
+        after_load();
         return v;
     }
 
     static void store(B *p, B v) {
-        asm volatile("fence rw, w" ::: "memory");
+        before_store();
+        _detail::mem_ops<B>::store_relaxed(p, v);
+        after_store();
+    }
+
+    static B load_relaxed(const B *p) {
+        return _detail::mem_ops<B>::load_relaxed(p);
+    }
+
+    static void store_relaxed(B *p, B v) {
         _detail::mem_ops<B>::store_relaxed(p, v);
     }
 };
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <assert.h>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <arch/dma_structs.hpp>
+#include <arch/spinlock.hpp>
+
+namespace arch {
+
+// Reference implementation of a dma_pool that manages memory supplied by the user
+// (e.g., memory that is allocated by the OS or mmap()ed memory in userspace).
+//
+// Allocations of up to max_slab_size bytes (after rounding up to a power of two that
+// is at least the alignment) are served from per-size slabs of one page each;
+// allocating and freeing such objects is O(1). Larger allocations are served by a
+// buddy allocator, i.e., they are naturally aligned to their size (rounded up to a power
+// of two) and can be at most 2^max_order bytes large.
+//
+// The pool does not allocate memory for its own metadata; instead, a small fraction
+// (one 16-byte entry per page) of each region is reserved for it.
+// Usage:
+//   slab_dma_pool pool;
+//   slab_dma_pool::region r{&pool, memory, size, bus_address};
+//   pool.add_region(&r);
+struct slab_dma_pool final : dma_pool {
+	static constexpr size_t page_size = 4096;
+	static constexpr size_t min_slab_size = 16;
+	static constexpr size_t max_slab_size = 2048;
+	static constexpr unsigned int max_order = 22;
+
+private:
+	static constexpr unsigned int _page_shift = 12;
+	static constexpr unsigned int _min_slab_shift = 4;
+	static constexpr unsigned int _max_slab_shift = 11;
+	static constexpr unsigned int _num_classes = _max_slab_shift - _min_slab_shift + 1;
+	static constexpr unsigned int _num_orders = max_order - _page_shift + 1;
+
+	static constexpr uint32_t _no_page = UINT32_MAX;
+	static constexpr uint16_t _no_object = UINT16_MAX;
+
+	static_assert(page_size == size_t(1) << _page_shift);
+	static_assert(min_slab_size == size_t(1) << _min_slab_shift);
+	static_assert(max_slab_size == size_t(1) << _max_slab_shift);
+
+	enum class _page_state : uint8_t {
+		// Page is used for metadata.
+		reserved,
+		// Page is part of a buddy block but not its first page.
+		interior,
+		// First page of a free buddy block.
+		free,
+		// First page of an allocated buddy block.
+		allocated,
+		// Page is a slab.
+		slab
+	};
+
+	struct _page_info {
+		// Links of the buddy free list or of the list of partially used slabs.
+		uint32_t next{_no_page};
+		uint32_t prev{_no_page};
+		// First free object of a slab (the free list is stored in the objects themselves).
+		uint16_t free_head{_no_object};
+		// Number of allocated objects of a slab.
+		uint16_t in_use{0};
+		// Objects beyond this index have never been allocated.
+		uint16_t bump{0};
+		// log2 of the block size (for buddy blocks) or of the object size (for slabs).
+		uint8_t shift{0};
+		_page_state state{_page_state::interior};
+	};
+
+	static_assert(sizeof(_page_info) == 16);
+
+public:
+	// Memory that is managed by the pool. The region must outlive the pool.
+	struct region : dma_region {
+		friend struct slab_dma_pool;
+
+		region(slab_dma_pool *pool, void *base, size_t size)
+		: dma_region{pool} {
+			auto va = reinterpret_cast<uintptr_t>(base);
+			base_va = va;
+
+			auto begin = (va + page_size - 1) & ~(page_size - 1);
+			auto end = (va + size) & ~(page_size - 1);
+			assert(begin < end);
+
+			size_t num_pages = (end - begin) >> _page_shift;
+			size_t meta_pages = (num_pages * sizeof(_page_info) + page_size - 1) >> _page_shift;
+			assert(meta_pages < num_pages);
+			assert(num_pages < _no_page);
+
+			_pages = reinterpret_cast<_page_info *>(begin);
+			_first = begin;
+			_data_begin = begin + (meta_pages << _page_shift);
+			_data_end = end;
+			for (size_t i = 0; i < num_pages; i++) {
+				auto p = new (&_pages[i]) _page_info{};
+				if (i < meta_pages)
+					p->state = _page_state::reserved;
+			}
+			for (auto &head : _free)
+				head = _no_page;
+			for (auto &head : _partial)
+				head = _no_page;
+		}
+
+		// Region that is contiguous on the bus, starting at bus address bus_base.
+		region(slab_dma_pool *pool, void *base, size_t size, uint64_t bus_base)
+		: region{pool, base, size} {
+			base_bus_address = bus_base;
+		}
+
+		// Region whose i-th chunk of 2^chunk_shift bytes (starting at base) is at bus address
+		// chunks[i]. The table is not copied; it must outlive the region.
+		region(slab_dma_pool *pool, void *base, size_t size,
+				std::span<const uint64_t> chunks, unsigned int chunk_shift)
+		: region{pool, base, size} {
+			assert(chunks.size() << chunk_shift >= size);
+			bus_chunks = chunks;
+			bus_chunk_shift = chunk_shift;
+		}
+
+	private:
+		_page_info *_pages;
+		// First page of the region (which contains the metadata).
+		uintptr_t _first;
+		// Pages that are available for allocations.
+		uintptr_t _data_begin;
+		uintptr_t _data_end;
+		// Buddy free lists, indexed by order - page shift.
+		uint32_t _free[_num_orders];
+		// Slabs that have free objects, indexed by size class.
+		uint32_t _partial[_num_classes];
+		region *_next{nullptr};
+	};
+
+	slab_dma_pool() = default;
+
+	slab_dma_pool(const slab_dma_pool &) = delete;
+
+	slab_dma_pool &operator= (const slab_dma_pool &) = delete;
+
+	void add_region(region *r) {
+		assert(r->pool() == this);
+
+		// Seed the buddy allocator with the largest naturally aligned blocks.
+		auto addr = r->_data_begin;
+		while (addr < r->_data_end) {
+			unsigned int order = max_order;
+			while ((addr & ((uintptr_t(1) << order) - 1))
+					|| addr + (uintptr_t(1) << order) > r->_data_end)
+				order--;
+			auto idx = _index(*r, addr);
+			r->_pages[idx].state = _page_state::free;
+			r->_pages[idx].shift = order;
+			_push(*r, r->_free[order - _page_shift], idx);
+			addr += uintptr_t(1) << order;
+		}
+
+		_lock.lock();
+		r->_next = _regions;
+		_regions = r;
+		_lock.unlock();
+	}
+
+	dma_ptr allocate(size_t size, size_t count, size_t align) override {
+		auto shift = _shift_for(size, count, align);
+		if (shift > max_order)
+			return {};
+
+		_lock.lock();
+		auto ptr = _allocate(shift);
+		_lock.unlock();
+		return ptr;
+	}
+
+	void deallocate(dma_ptr ptr, size_t size, size_t count, size_t align) override {
+		if (!ptr)
+			return;
+		auto shift = _shift_for(size, count, align);
+
+		_lock.lock();
+		_deallocate(ptr, shift);
+		_lock.unlock();
+	}
+
+	size_t allocate_bulk(std::span<dma_ptr> ptrs, size_t size, size_t count, size_t align) override {
+		auto shift = _shift_for(size, count, align);
+		if (shift > max_order)
+			return 0;
+
+		size_t n = 0;
+		_lock.lock();
+		while (n < ptrs.size()) {
+			auto ptr = _allocate(shift);
+			if (!ptr)
+				break;
+			ptrs[n++] = ptr;
+		}
+		_lock.unlock();
+		return n;
+	}
+
+	void deallocate_bulk(std::span<const dma_ptr> ptrs, size_t size, size_t count, size_t align) override {
+		auto shift = _shift_for(size, count, align);
+
+		_lock.lock();
+		for (auto ptr : ptrs) {
+			if (ptr)
+				_deallocate(ptr, shift);
+		}
+		_lock.unlock();
+	}
+
+private:
+	// Returns log2 of the size of the slab object or buddy block that serves an allocation.
+	// Returns a value larger than max_order if the allocation cannot be satisfied.
+	static unsigned int _shift_for(size_t size, size_t count, size_t align) {
+		size_t bytes;
+		if (__builtin_mul_overflow(size, count, &bytes))
+			return max_order + 1;
+		if (bytes < align)
+			bytes = align;
+		if (bytes <= min_slab_size)
+			return _min_slab_shift;
+		return sizeof(size_t) * 8 - __builtin_clzl(bytes - 1);
+	}
+
+	// The following functions must be called with _lock held.
+
+	dma_ptr _allocate(unsigned int shift) {
+		for (auto r = _regions; r; r = r->_next) {
+			auto addr = shift <= _max_slab_shift
+					? _alloc_object(*r, shift)
+					: _alloc_block(*r, shift);
+			if (addr)
+				return dma_ptr{r, addr - r->get_base_va()};
+		}
+		return {};
+	}
+
+	void _deallocate(dma_ptr ptr, unsigned int shift) {
+		auto r = static_cast<region *>(ptr.region());
+		assert(r->pool() == this);
+		auto addr = r->get_base_va() + ptr.offset();
+		if (shift <= _max_slab_shift) {
+			_free_object(*r, addr, shift);
+		} else {
+			_free_block(*r, addr, shift);
+		}
+	}
+
+	static uint32_t _index(region &r, uintptr_t addr) {
+		return (addr - r._first) >> _page_shift;
+	}
+
+	static uintptr_t _address(region &r, uint32_t idx) {
+		return r._first + (uintptr_t(idx) << _page_shift);
+	}
+
+	static void _push(region &r, uint32_t &head, uint32_t idx) {
+		auto &p = r._pages[idx];
+		p.prev = _no_page;
+		p.next = head;
+		if (head != _no_page)
+			r._pages[head].prev = idx;
+		head = idx;
+	}
+
+	static void _remove(region &r, uint32_t &head, uint32_t idx) {
+		auto &p = r._pages[idx];
+		if (p.prev != _no_page) {
+			r._pages[p.prev].next = p.next;
+		} else {
+			head = p.next;
+		}
+		if (p.next != _no_page)
+			r._pages[p.next].prev = p.prev;
+	}
+
+	static uintptr_t _alloc_block(region &r, unsigned int order) {
+		auto j = order;
+		while (j <= max_order && r._free[j - _page_shift] == _no_page)
+			j++;
+		if (j > max_order)
+			return 0;
+
+		auto idx = r._free[j - _page_shift];
+		_remove(r, r._free[j - _page_shift], idx);
+		auto addr = _address(r, idx);
+		// Split the block and put the upper halves back onto the free lists.
+		while (j > order) {
+			j--;
+			auto half = _index(r, addr + (uintptr_t(1) << j));
+			r._pages[half].state = _page_state::free;
+			r._pages[half].shift = j;
+			_push(r, r._free[j - _page_shift], half);
+		}
+		r._pages[idx].state = _page_state::allocated;
+		r._pages[idx].shift = order;
+		return addr;
+	}
+
+	static void _free_block(region &r, uintptr_t addr, unsigned int order) {
+		assert(r._pages[_index(r, addr)].state == _page_state::allocated);
+		assert(r._pages[_index(r, addr)].shift == order);
+
+		// Merge the block with its buddy as long as the buddy is free.
+		while (order < max_order) {
+			auto buddy = addr ^ (uintptr_t(1) << order);
+			if (buddy < r._data_begin || buddy + (uintptr_t(1) << order) > r._data_end)
+				break;
+			auto &b = r._pages[_index(r, buddy)];
+			if (b.state != _page_state::free || b.shift != order)
+				break;
+			_remove(r, r._free[order - _page_shift], _index(r, buddy));
+			auto upper = addr > buddy ? addr : buddy;
+			r._pages[_index(r, upper)].state = _page_state::interior;
+			addr = addr < buddy ? addr : buddy;
+			order++;
+		}
+
+		auto idx = _index(r, addr);
+		r._pages[idx].state = _page_state::free;
+		r._pages[idx].shift = order;
+		_push(r, r._free[order - _page_shift], idx);
+	}
+
+	static uintptr_t _alloc_object(region &r, unsigned int shift) {
+		auto &partial = r._partial[shift - _min_slab_shift];
+		if (partial == _no_page) {
+			auto page = _alloc_block(r, _page_shift);
+			if (!page)
+				return 0;
+			auto idx = _index(r, page);
+			auto &p = r._pages[idx];
+			p.state = _page_state::slab;
+			p.shift = shift;
+			p.free_head = _no_object;
+			p.in_use = 0;
+			p.bump = 0;
+			_push(r, partial, idx);
+		}
+
+		auto idx = partial;
+		auto &p = r._pages[idx];
+		auto page = _address(r, idx);
+		uint16_t object;
+		if (p.free_head != _no_object) {
+			object = p.free_head;
+			__builtin_memcpy(&p.free_head, reinterpret_cast<void *>(page + (uintptr_t(object) << shift)),
+					sizeof(uint16_t));
+		} else {
+			object = p.bump++;
+		}
+		if (++p.in_use == page_size >> shift)
+			_remove(r, partial, idx);
+		return page + (uintptr_t(object) << shift);
+	}
+
+	static void _free_object(region &r, uintptr_t addr, unsigned int shift) {
+		auto &partial = r._partial[shift - _min_slab_shift];
+		auto idx = _index(r, addr);
+		auto &p = r._pages[idx];
+		assert(p.state == _page_state::slab);
+		assert(p.shift == shift);
+
+		auto page = _address(r, idx);
+		__builtin_memcpy(reinterpret_cast<void *>(addr), &p.free_head, sizeof(uint16_t));
+		p.free_head = (addr - page) >> shift;
+		if (p.in_use-- == page_size >> shift)
+			_push(r, partial, idx);
+		if (!p.in_use) {
+			_remove(r, partial, idx);
+			p.state = _page_state::allocated;
+			p.shift = _page_shift;
+			_free_block(r, page, _page_shift);
+		}
+	}
+
+	spinlock _lock;
+	region *_regions{nullptr};
+};
+
+} // namespace arch
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <arch/mem_space.hpp>
+
+namespace arch {
+
+// Simple test-and-test-and-set spin lock (e.g., for the DMA pools that libarch provides).
+// Satisfies the Lockable requirements such that it can be used with std::unique_lock.
+struct spinlock {
+	constexpr spinlock() = default;
+
+	spinlock(const spinlock &) = delete;
+
+	spinlock &operator= (const spinlock &) = delete;
+
+	void lock() {
+		while (__atomic_exchange_n(&_locked, true, __ATOMIC_ACQUIRE)) {
+			while (__atomic_load_n(&_locked, __ATOMIC_RELAXED))
+				_detail::cpu_relax();
+		}
+	}
+
+	bool try_lock() {
+		if (__atomic_load_n(&_locked, __ATOMIC_RELAXED))
+			return false;
+		return !__atomic_exchange_n(&_locked, true, __ATOMIC_ACQUIRE);
+	}
+
+	void unlock() {
+		__atomic_store_n(&_locked, false, __ATOMIC_RELEASE);
+	}
+
+private:
+	bool _locked{false};
+};
+
+} // namespace arch
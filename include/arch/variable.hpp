@@ -29,6 +29,29 @@ struct basic_variable {
 		return static_cast<R>(_detail::mem_ops<B>::atomic_exchange(&_embedded, static_cast<B>(r)));
 	}
 
+	// If the variable equals expected, replaces it by desired and returns true.
+	// Otherwise, stores the current value to expected and returns false.
+	bool compare_exchange(R &expected, R desired) {
+		auto b = static_cast<B>(expected);
+		bool success = _detail::mem_ops<B>::atomic_compare_exchange(&_embedded, b,
+				static_cast<B>(desired));
+		expected = static_cast<R>(b);
+		return success;
+	}
+
+	// Takes the bits type since adding to bit_values is not meaningful.
+	R fetch_add(B v) {
+		return static_cast<R>(_detail::mem_ops<B>::atomic_fetch_add(&_embedded, v));
+	}
+
+	R fetch_or(R r) {
+		return static_cast<R>(_detail::mem_ops<B>::atomic_fetch_or(&_embedded, static_cast<B>(r)));
+	}
+
+	R fetch_and(R r) {
+		return static_cast<R>(_detail::mem_ops<B>::atomic_fetch_and(&_embedded, static_cast<B>(r)));
+	}
+
 private:
 	B _embedded;
 };
@@ -3,37 +3,256 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <arch/x86/cpuid.hpp>
+
 namespace arch {
 
 namespace detail_ {
 
-inline size_t dcache_line_size() {
-	// TODO: This information has to be obtained from CPUID.
+// cache_features() packs the line size into the low 16 bits and flags into the upper bits.
+inline constexpr uint32_t cache_line_size_mask = 0xFFFF;
+inline constexpr uint32_t cache_feature_probed = uint32_t(1) << 16;
+inline constexpr uint32_t cache_feature_clflushopt = uint32_t(1) << 17;
+inline constexpr uint32_t cache_feature_clwb = uint32_t(1) << 18;
+
+// Zero until the CPU has been probed. Probing is idempotent, hence racing
+// probes on multiple CPUs are harmless.
+inline uint32_t cache_features_ = 0;
+
+inline uint32_t probe_cache_features() {
+	uint32_t features = cache_feature_probed;
+
+	// CPUID.01H:EBX[15:8] is the CLFLUSH line size in units of 8 bytes.
+	// It is only valid if CPUID.01H:EDX.CLFSH is set.
+	auto leaf1 = cpuid(1);
+	uint32_t line_size = 0;
+	if (leaf1.edx & (uint32_t(1) << 19))
+		line_size = ((leaf1.ebx >> 8) & 0xFF) * 8;
 	// 64 should be a safe guess for current CPUs (might result in some extra
 	// clflush instructions at worst).
-	return 64;
+	if (!line_size)
+		line_size = 64;
+	features |= line_size;
+
+	if (cpuid_max_leaf() >= 7) {
+		auto leaf7 = cpuid(7, 0);
+		if (leaf7.ebx & (uint32_t(1) << 23))
+			features |= cache_feature_clflushopt;
+		if (leaf7.ebx & (uint32_t(1) << 24))
+			features |= cache_feature_clwb;
+	}
+
+	__atomic_store_n(&cache_features_, features, __ATOMIC_RELAXED);
+	return features;
+}
+
+inline uint32_t cache_features() {
+	auto features = __atomic_load_n(&cache_features_, __ATOMIC_RELAXED);
+	if (!features) [[unlikely]]
+		features = probe_cache_features();
+	return features;
+}
+
+inline size_t dcache_line_size() {
+	return cache_features() & cache_line_size_mask;
+}
+
+// Write back and invalidate cache lines. Needs to be followed by cache_fence().
+// If L is non-zero, it is used as the cache line size.
+template<size_t L = 0>
+inline void cache_clflush_lines(uintptr_t addr, size_t size) {
+	auto features = cache_features();
+	size_t dsz = L ? L : features & cache_line_size_mask;
+	auto begin = addr & ~(dsz - 1);
+	size_t n = (addr + size - begin + dsz - 1) >> __builtin_ctzl(dsz);
+	if (features & cache_feature_clflushopt) {
+		for (size_t i = 0; i < n; i++) {
+			asm volatile ("clflushopt {(%0)|[%0]}" :: "r"(begin + i * dsz) : "memory");
+		}
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			asm volatile ("clflush {(%0)|[%0]}" :: "r"(begin + i * dsz) : "memory");
+		}
+	}
+}
+
+// Write back cache lines. The lines may or may not stay in the cache.
+// Needs to be followed by cache_fence(). If L is non-zero, it is used as the cache line size.
+template<size_t L = 0>
+inline void cache_clwb_lines(uintptr_t addr, size_t size) {
+	auto features = cache_features();
+	size_t dsz = L ? L : features & cache_line_size_mask;
+	if (!(features & cache_feature_clwb)) {
+		cache_clflush_lines<L>(addr, size);
+		return;
+	}
+	auto begin = addr & ~(dsz - 1);
+	size_t n = (addr + size - begin + dsz - 1) >> __builtin_ctzl(dsz);
+	for (size_t i = 0; i < n; i++) {
+		asm volatile ("clwb {(%0)|[%0]}" :: "r"(begin + i * dsz) : "memory");
+	}
+}
+
+// clflush is ordered against stores but clflushopt and clwb are only ordered by fences.
+// Hence, one sfence after all lines of a range (or a batch of ranges) suffices.
+inline void cache_fence() {
+	if (cache_features() & (cache_feature_clflushopt | cache_feature_clwb))
+		asm volatile ("sfence" ::: "memory");
+}
+
+// Copy size bytes to dst and write them back. Whole lines of dst are written
+// using non-temporal stores (that bypass the cache), partial lines at the start and
+// end are copied normally and written back. Needs to be followed by sfence.
+template<size_t L = 0>
+inline void cache_copy_nt(void *dst, const void *src, size_t size) {
+	size_t dsz = L ? L : dcache_line_size();
+	auto d = reinterpret_cast<uintptr_t>(dst);
+	auto s = static_cast<const char *>(src);
+	auto first = (d + dsz - 1) & ~(dsz - 1);
+	auto last = (d + size) & ~(dsz - 1);
+	if (first >= last) {
+		__builtin_memcpy(dst, src, size);
+		cache_clwb_lines<L>(d, size);
+		return;
+	}
+
+	if (auto head = first - d; head) {
+		__builtin_memcpy(dst, src, head);
+		cache_clwb_lines<L>(d, head);
+	}
+	for (auto cur = first; cur < last; cur += sizeof(uintptr_t)) {
+		uintptr_t word;
+		__builtin_memcpy(&word, s + (cur - d), sizeof(uintptr_t));
+		asm volatile ("movnti {%1, %0|%0, %1}"
+			: "=m"(*reinterpret_cast<uintptr_t *>(cur)) : "r"(word));
+	}
+	if (auto tail = d + size - last; tail) {
+		__builtin_memcpy(reinterpret_cast<void *>(last), s + (last - d), tail);
+		cache_clwb_lines<L>(last, tail);
+	}
 }
 
-inline void cache_clflush(uintptr_t addr, size_t size) {
-	auto dsz = dcache_line_size();
-	for (auto cur = addr & ~(dsz - 1); cur < addr + size; cur += dsz) {
-		asm volatile ("clflush {(%0)|[%0]}" :: "r"(cur) : "memory");
+// Ranges of at least this size are written back using wbinvd.
+// wbinvd is a privileged instruction, hence this is disabled by default.
+inline size_t whole_cache_threshold_ = SIZE_MAX;
+
+inline bool use_whole_cache(size_t size) {
+	return size >= __atomic_load_n(&whole_cache_threshold_, __ATOMIC_RELAXED);
+}
+
+// Write back and invalidate all caches.
+inline void cache_wbinvd() {
+	asm volatile ("wbinvd" ::: "memory");
+}
+
+// Returns the size of the largest data or unified cache enumerated by the
+// deterministic cache parameters leaf (4 on Intel, 0x8000001D on AMD).
+inline size_t largest_dcache_size(uint32_t leaf) {
+	size_t largest = 0;
+	for (uint32_t i = 0; ; i++) {
+		auto r = cpuid(leaf, i);
+		auto type = r.eax & 0x1F;
+		if (!type)
+			break;
+		if (type == 2) // Instruction cache.
+			continue;
+		size_t ways = ((r.ebx >> 22) & 0x3FF) + 1;
+		size_t partitions = ((r.ebx >> 12) & 0x3FF) + 1;
+		size_t line_size = (r.ebx & 0xFFF) + 1;
+		size_t sets = size_t(r.ecx) + 1;
+		auto size = ways * partitions * line_size * sets;
+		if (size > largest)
+			largest = size;
 	}
+	return largest;
 }
 
+// Maintenance operations used by arch/cache.hpp.
+// lines<L>() walks a range without a trailing barrier (using a line size of L unless L is zero),
+// fence() completes all preceding lines() calls and try_whole() maintains the entire cache
+// if that is cheaper than walking size bytes.
+
+struct writeback_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_clwb_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t size) {
+		if (!use_whole_cache(size))
+			return false;
+		cache_wbinvd();
+		return true;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
+using clean_or_invalidate_op = writeback_op;
+
+// copy() copies a range and writes it back without a trailing barrier.
+struct copy_writeback_op {
+	template<size_t L = 0>
+	static void copy(void *dst, const void *src, size_t size) {
+#if defined(__x86_64__) || defined(__SSE2__)
+		cache_copy_nt<L>(dst, src, size);
+#else
+		__builtin_memcpy(dst, src, size);
+		cache_clwb_lines<L>(reinterpret_cast<uintptr_t>(dst), size);
+#endif
+	}
+
+	static void fence() {
+		// Non-temporal stores are weakly ordered, hence we always need a fence here.
+		asm volatile ("sfence" ::: "memory");
+	}
+};
+
+struct invalidate_op {
+	template<size_t L = 0>
+	static void lines(uintptr_t addr, size_t size) {
+		cache_clflush_lines<L>(addr, size);
+	}
+
+	static bool try_whole(size_t size) {
+		if (!use_whole_cache(size))
+			return false;
+		cache_wbinvd();
+		return true;
+	}
+
+	static void fence() {
+		cache_fence();
+	}
+};
+
 } // namespace detail_
 
 
-inline void cache_writeback(uintptr_t addr, size_t size) {
-	detail_::cache_clflush(addr, size);
+// Ranges of at least size bytes are maintained by writing back and invalidating
+// the entire cache instead of walking the range line by line.
+// Since this uses wbinvd, this may only be enabled if the caller runs in ring 0.
+inline void set_whole_cache_threshold(size_t size) {
+	__atomic_store_n(&detail_::whole_cache_threshold_, size, __ATOMIC_RELAXED);
 }
 
-inline void cache_clean_or_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_clflush(addr, size);
+inline size_t whole_cache_threshold() {
+	return __atomic_load_n(&detail_::whole_cache_threshold_, __ATOMIC_RELAXED);
 }
 
-inline void cache_invalidate(uintptr_t addr, size_t size) {
-	detail_::cache_clflush(addr, size);
+// Sets the whole cache threshold to the size of the largest data cache.
+// Beyond that size, walking the range costs more than writing back everything
+// that the caches can possibly hold. Same restrictions as set_whole_cache_threshold().
+inline void calibrate_whole_cache_threshold() {
+	size_t size = 0;
+	if (cpuid_max_leaf() >= 4)
+		size = detail_::largest_dcache_size(4);
+	if (!size && cpuid(0x80000000).eax >= 0x8000001D)
+		size = detail_::largest_dcache_size(0x8000001D);
+	if (size)
+		set_whole_cache_threshold(size);
 }
 
 } // namespace arch
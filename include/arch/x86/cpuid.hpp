@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace arch {
+
+struct cpuid_result {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+};
+
+inline cpuid_result cpuid(uint32_t leaf, uint32_t subleaf = 0) {
+	cpuid_result r;
+	asm ("cpuid"
+		: "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx)
+		: "a"(leaf), "c"(subleaf));
+	return r;
+}
+
+// Returns the highest basic CPUID leaf supported by the CPU.
+inline uint32_t cpuid_max_leaf() {
+	return cpuid(0).eax;
+}
+
+} // namespace arch
@@ -4,17 +4,88 @@
 #include <stdint.h>
 
 #include <arch/register.hpp>
+#include <arch/x86/cpuid.hpp>
 
 namespace arch {
 
 namespace _detail {
+	// Barriers that are required around relaxed accesses to implement load() and store().
+	// x86 has TSO, hence we only need to prevent compiler reordering.
+	struct mem_barriers {
+		static void before_load() {
+			asm volatile ("" ::: "memory");
+		}
+		static void after_load() {
+			asm volatile ("" ::: "memory");
+		}
+
+		static void before_store() {
+			asm volatile ("" ::: "memory");
+		}
+		static void after_store() {
+			asm volatile ("" ::: "memory");
+		}
+	};
+
+	// Spin-wait hint used while polling device registers.
+	inline void cpu_relax() {
+		asm volatile ("pause" ::: "memory");
+	}
+
+	// Atomic read-modify-write operations on normal memory.
+	// The operand size is inferred from the register operands, hence these are
+	// shared by all widths. All of them are full barriers.
+	template<typename B>
+	struct atomic_ops {
+		static B atomic_exchange(B *p, B v) {
+			// xchg with a memory operand is implicitly locked.
+			asm volatile ("xchg {%0, %1|%1, %0}" : "+r"(v), "+m"(*p) : : "memory");
+			return v;
+		}
+
+		// If *p == expected, replaces *p by desired and returns true.
+		// Otherwise, stores the current value of *p to expected and returns false.
+		static bool atomic_compare_exchange(B *p, B &expected, B desired) {
+			bool success;
+			asm volatile ("lock cmpxchg {%3, %1|%1, %3}"
+					: "+a"(expected), "+m"(*p), "=@ccz"(success)
+					: "r"(desired) : "memory");
+			return success;
+		}
+
+		static B atomic_fetch_add(B *p, B v) {
+			asm volatile ("lock xadd {%0, %1|%1, %0}" : "+r"(v), "+m"(*p) : : "memory");
+			return v;
+		}
+
+		// lock or and lock and do not return the old value, hence we use cmpxchg loops.
+		static B atomic_fetch_or(B *p, B v) {
+			B old;
+			asm volatile ("mov {%1, %0|%0, %1}" : "=r"(old) : "m"(*p));
+			while (!atomic_compare_exchange(p, old, old | v))
+				;
+			return old;
+		}
+
+		static B atomic_fetch_and(B *p, B v) {
+			B old;
+			asm volatile ("mov {%1, %0|%0, %1}" : "=r"(old) : "m"(*p));
+			while (!atomic_compare_exchange(p, old, old & v))
+				;
+			return old;
+		}
+	};
+
 	template<typename B>
 	struct mem_ops;
 
 	template<>
-	struct mem_ops<uint8_t> {
+	struct mem_ops<uint8_t> : mem_barriers, atomic_ops<uint8_t> {
 		static void store(uint8_t *p, uint8_t v) {
-			asm volatile ("mov{b %0, %1| %1, %0}" : : "r"(v), "m"(*p) : "memory");
+			asm volatile ("mov{b %1, %0| %0, %1}" : "=m"(*p) : "r"(v) : "memory");
+		}
+		static void store_relaxed(uint8_t *p, uint8_t v) {
+			asm volatile ("mov{b %1, %0| %0, %1}" : "=m"(*p) : "r"(v));
 		}
 
 		static uint8_t load(const uint8_t *p) {
@@ -22,15 +93,20 @@ namespace _detail {
 			asm volatile ("mov{b %1, %0| %0, %1}" : "=r"(v) : "m"(*p) : "memory");
 			return v;
 		}
+		static uint8_t load_relaxed(const uint8_t *p) {
+			uint8_t v;
+			asm volatile ("mov{b %1, %0| %0, %1}" : "=r"(v) : "m"(*p));
+			return v;
+		}
 	};
 
 	template<>
-	struct mem_ops<uint16_t> {
+	struct mem_ops<uint16_t> : mem_barriers, atomic_ops<uint16_t> {
 		static void store(uint16_t *p, uint16_t v) {
-			asm volatile ("mov{w %0, %1| %1, %0}" : : "r"(v), "m"(*p) : "memory");
+			asm volatile ("mov{w %1, %0| %0, %1}" : "=m"(*p) : "r"(v) : "memory");
 		}
 		static void store_relaxed(uint16_t *p, uint16_t v) {
-			asm volatile ("mov{w %0, %1| %1, %0}" : : "r"(v), "m"(*p));
+			asm volatile ("mov{w %1, %0| %0, %1}" : "=m"(*p) : "r"(v));
 		}
 
 		static uint16_t load(const uint16_t *p) {
@@ -46,12 +122,12 @@ namespace _detail {
 	};
 
 	template<>
-	struct mem_ops<uint32_t> {
+	struct mem_ops<uint32_t> : mem_barriers, atomic_ops<uint32_t> {
 		static void store(uint32_t *p, uint32_t v) {
-			asm volatile ("mov{l %0, %1| %1, %0}" : : "r"(v), "m"(*p) : "memory");
+			asm volatile ("mov{l %1, %0| %0, %1}" : "=m"(*p) : "r"(v) : "memory");
 		}
 		static void store_relaxed(uint32_t *p, uint32_t v) {
-			asm volatile ("mov{l %0, %1| %1, %0}" : : "r"(v), "m"(*p));
+			asm volatile ("mov{l %1, %0| %0, %1}" : "=m"(*p) : "r"(v));
 		}
 
 		static uint32_t load(const uint32_t *p) {
@@ -67,12 +143,12 @@ namespace _detail {
 	};
 
 	template<>
-	struct mem_ops<uint64_t> {
+	struct mem_ops<uint64_t> : mem_barriers, atomic_ops<uint64_t> {
 		static void store(uint64_t *p, uint64_t v) {
-			asm volatile ("mov{q %0, %1| %1, %0}" : : "r"(v), "m"(*p) : "memory");
+			asm volatile ("mov{q %1, %0| %0, %1}" : "=m"(*p) : "r"(v) : "memory");
 		}
 		static void store_relaxed(uint64_t *p, uint64_t v) {
-			asm volatile ("mov{q %0, %1| %1, %0}" : : "r"(v), "m"(*p));
+			asm volatile ("mov{q %1, %0| %0, %1}" : "=m"(*p) : "r"(v));
 		}
 
 		static uint64_t load(const uint64_t *p) {
@@ -85,12 +161,45 @@ namespace _detail {
 			asm volatile ("mov{q %1, %0| %0, %1}" : "=r"(v) : "m"(*p));
 			return v;
 		}
+	};
 
-		static uint64_t atomic_exchange(uint64_t *p, uint64_t v) {
-			asm volatile ("xchg{q %0, %1| %1, %0}" : "+r"(v) : "m"(*p) : "memory");
-			return v;
+	// Zero until probed, one if movdir64b is not available and two if it is.
+	inline int movdir64b_support_ = 0;
+
+	inline bool has_movdir64b() {
+		auto support = __atomic_load_n(&movdir64b_support_, __ATOMIC_RELAXED);
+		if (!support) [[unlikely]] {
+			// CPUID.07H.0H:ECX.MOVDIR64B[bit 28].
+			bool available = cpuid_max_leaf() >= 7 && (cpuid(7, 0).ecx & (uint32_t(1) << 28));
+			support = available ? 2 : 1;
+			__atomic_store_n(&movdir64b_support_, support, __ATOMIC_RELAXED);
 		}
-	};
+		return support == 2;
+	}
+
+	// Stores a prefix of [src,src+size) to dst using accesses wider than 64 bits.
+	// Returns the number of bytes that were stored.
+	inline size_t store_burst_wide(void *dst, const void *src, size_t size) {
+		auto d = reinterpret_cast<uintptr_t>(dst);
+		auto s = static_cast<const char *>(src);
+		if ((d & 63) || size < 64 || !has_movdir64b())
+			return 0;
+
+		// movdir64b is weakly ordered (like WC stores), hence we need fences around it.
+		size_t n = size & ~size_t(63);
+		asm volatile ("sfence" ::: "memory");
+		for (size_t i = 0; i < n; i += 64) {
+			asm volatile ("movdir64b {(%1), %0|%0, [%1]}" : : "r"(d + i), "r"(s + i) : "memory");
+		}
+		asm volatile ("sfence" ::: "memory");
+		return n;
+	}
+
+	// Loads a prefix of [src,src+size) into dst using accesses wider than 64 bits.
+	// Such loads would require vector registers, hence we do not use them.
+	inline size_t load_burst_wide(void *, const void *, size_t) {
+		return 0;
+	}
 }
 
 // x86 has TSO which is strong enough to not require barriers anywhere.
@@ -0,0 +1,163 @@
+// Exercises slab_dma_pool (and magazine_dma_pool on top of it) over mmap()ed memory.
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <arch/magazine_pool.hpp>
+#include <arch/slab_pool.hpp>
+
+namespace {
+
+constexpr size_t region_size = 16 << 20;
+
+int failures = 0;
+
+void check(bool cond, const char *what) {
+	if (!cond) {
+		fprintf(stderr, "slab_pool: check failed: %s\n", what);
+		failures++;
+	}
+}
+
+// Returns the number of 4 MiB blocks that can be allocated (and frees them again).
+size_t count_large_blocks(arch::slab_dma_pool &pool) {
+	arch::dma_ptr ptrs[16];
+	auto n = pool.allocate_bulk(ptrs, size_t(1) << 22, 1, 1);
+	pool.deallocate_bulk(std::span{ptrs, n}, size_t(1) << 22, 1, 1);
+	return n;
+}
+
+void test_slab_and_buddy(arch::slab_dma_pool &pool) {
+	struct allocation {
+		arch::dma_ptr ptr;
+		size_t size;
+		size_t align;
+	};
+	allocation allocs[64];
+	size_t n = 0;
+	for (size_t size = 1; size <= (size_t(1) << 18); size = size * 3 + 1) {
+		for (size_t align : {1, 64, 4096}) {
+			auto ptr = pool.allocate(size, 1, align);
+			check(static_cast<bool>(ptr), "allocation succeeds");
+			auto va = reinterpret_cast<uintptr_t>(ptr.get_raw_ptr());
+			check(!(va % align), "allocation is aligned");
+			memset(ptr.get_raw_ptr(), static_cast<int>(n), size);
+			allocs[n++] = {ptr, size, align};
+		}
+	}
+
+	// No allocation may overwrite another one.
+	for (size_t i = 0; i < n; i++) {
+		auto p = allocs[i].ptr.get_raw_ptr<unsigned char>();
+		for (size_t j = 0; j < allocs[i].size; j++) {
+			if (p[j] != static_cast<unsigned char>(i)) {
+				check(false, "allocations do not overlap");
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n; i++)
+		pool.deallocate(allocs[i].ptr, allocs[i].size, 1, allocs[i].align);
+}
+
+void test_magazine(arch::slab_dma_pool &pool) {
+	arch::magazine_dma_pool<4, 16> mag{&pool};
+
+	arch::dma_buffer buffers[100];
+	auto n = arch::dma_buffer::allocate_bulk(&mag, buffers, 200);
+	check(n == 100, "bulk allocation succeeds");
+	for (auto &buffer : buffers) {
+		check(buffer.get_dma_ptr().pool() == &mag, "buffers are freed through the magazines");
+		memset(buffer.data(), 0xAB, buffer.size());
+	}
+	arch::dma_buffer::deallocate_bulk(buffers);
+	check(!buffers[0].data(), "bulk deallocation resets the buffers");
+
+	for (int i = 0; i < 1000; i++)
+		arch::dma_buffer b{&mag, static_cast<size_t>(i % 3000) + 1};
+}
+
+void test_segments(arch::slab_dma_pool &pool, uintptr_t base, uint64_t bus_base) {
+	arch::dma_buffer buffer{&pool, 3 * 4096};
+	arch::dma_buffer_view view = buffer;
+	auto offset = reinterpret_cast<uintptr_t>(buffer.data()) - base;
+	check(view.bus_address() == bus_base + offset, "bus address matches the region");
+
+	size_t segments = 0;
+	for (auto segment : view.subview(100).segments()) {
+		check(segment.bus_address == bus_base + offset + 100, "segment starts at the buffer");
+		check(segment.size == view.size() - 100, "contiguous region yields one segment");
+		segments++;
+	}
+	check(segments == 1, "contiguous region yields one segment");
+
+	auto host = arch::make_host_dma_ptr(buffer.data());
+	check(!host.bus_address(), "host pointers have no bus address");
+}
+
+// Region whose bus_chunks table only covers the first two of its three 4 KiB chunks.
+struct short_table_region : arch::dma_region {
+	short_table_region(uintptr_t base)
+	: dma_region{nullptr} {
+		base_va = base;
+		bus_chunks = chunks;
+		bus_chunk_shift = 12;
+	}
+
+	const uint64_t chunks[2] = {0x1000'0000, 0x1000'1000};
+};
+
+void test_incomplete_segments(uintptr_t base) {
+	short_table_region region{base};
+	arch::dma_buffer_view view{arch::dma_ptr{&region, 0x800}, 0x2000};
+
+	size_t segments = 0;
+	for (auto segment : view.segments()) {
+		check(segment.bus_address == 0x1000'0800, "segment starts at the buffer");
+		check(segment.size == 0x1800, "segment ends at the end of the table");
+		segments++;
+	}
+	check(segments == 1, "adjacent chunks are merged");
+	check(view.segments().unmapped() == 0x800, "unmapped bytes are reported");
+	check(!view.segments().complete(), "truncated segments are reported");
+	check(view.subview(0, 0x1800).segments().complete(), "mapped ranges are complete");
+
+	arch::dma_buffer_view host{nullptr, reinterpret_cast<void *>(base), 64};
+	check(host.segments().begin() == host.segments().end(), "host buffers have no segments");
+	check(host.segments().unmapped() == 64, "host buffers are entirely unmapped");
+}
+
+} // namespace
+
+int main() {
+	auto memory = mmap(nullptr, region_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	auto base = reinterpret_cast<uintptr_t>(memory);
+	uint64_t bus_base = 0x8000'0000;
+
+	{
+		arch::slab_dma_pool pool;
+		arch::slab_dma_pool::region region{&pool, memory, region_size, bus_base};
+		pool.add_region(&region);
+
+		auto initial = count_large_blocks(pool);
+		check(initial > 0, "region contains large blocks");
+
+		test_slab_and_buddy(pool);
+		test_magazine(pool);
+		test_segments(pool, base, bus_base);
+		test_incomplete_segments(base);
+
+		// All memory must be coalesced again.
+		check(count_large_blocks(pool) == initial, "freed memory is coalesced");
+	}
+
+	munmap(memory, region_size);
+	return failures ? 1 : 0;
+}
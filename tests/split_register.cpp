@@ -0,0 +1,68 @@
+// Exercises split_register through the run-time, static and scoped accessors of mem_space.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <arch/mem_space.hpp>
+#include <arch/register.hpp>
+
+namespace {
+
+namespace regs {
+	inline constexpr arch::bit_register<uint32_t> ctrl{0x00};
+	inline constexpr arch::split_register<uint64_t, uint32_t> head{0x04};
+	inline constexpr arch::split_register<uint64_t, uint32_t, arch::split_order::hi_lo> tail{0x0C};
+	using block = arch::register_block<ctrl, head, tail>;
+}
+
+static_assert(regs::block::size == 0x14);
+static_assert(regs::block::contains<regs::head>);
+
+int failures = 0;
+
+void check(bool cond, const char *what) {
+	if (!cond) {
+		fprintf(stderr, "split_register: check failed: %s\n", what);
+		failures++;
+	}
+}
+
+uint32_t half(const uint32_t *mem, ptrdiff_t offset) {
+	return mem[offset / sizeof(uint32_t)];
+}
+
+} // namespace
+
+int main() {
+	uint32_t mem[8] = {};
+	arch::mem_space space{mem};
+
+	space.store(regs::head, 0x1122334455667788);
+	check(half(mem, 0x04) == 0x55667788 && half(mem, 0x08) == 0x11223344,
+			"store() writes the lower half at the lower offset");
+	check(space.load(regs::head) == 0x1122334455667788, "load() combines both halves");
+
+	space.store<regs::tail>(0xAABBCCDD00112233);
+	check(half(mem, 0x0C) == 0x00112233 && half(mem, 0x10) == 0xAABBCCDD,
+			"static store() accesses both halves");
+	check(space.load<regs::tail>() == 0xAABBCCDD00112233, "static load() combines both halves");
+
+	space.store_relaxed<regs::head>(42);
+	check(space.load_relaxed<regs::head>() == 42, "static relaxed accesses");
+
+	{
+		arch::mem_space::store_scope stores{space};
+		stores.store(regs::head, 1);
+		stores.store<regs::tail>(uint64_t(2) << 32);
+	}
+	{
+		arch::mem_space::load_scope loads{space};
+		check(loads.load<regs::head>() == 1, "load_scope loads split registers");
+		check(loads.load(regs::tail) == uint64_t(2) << 32, "load_scope loads split registers");
+	}
+
+	auto v = space.poll_until(regs::tail, [] (uint64_t v) { return v >> 32 == 2; });
+	check(v == uint64_t(2) << 32, "poll_until() polls split registers");
+
+	return failures ? 1 : 0;
+}